@@ -1,4 +1,5 @@
 #include "raylib.h"
+#include "rlgl.h"
 #include <vector>
 #include <algorithm>
 #include <ctime>
@@ -8,12 +9,41 @@
 #include <fstream>
 #include <sstream>
 #include <queue>
+#include <deque>
+#include <memory>
+#include <chrono>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <atomic>
 #include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <coroutine>
+#include <filesystem>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <cerrno>
+#include <csignal>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#endif
 
 using namespace std;
 
@@ -26,17 +56,51 @@ const int LANE_WIDTH = 120;
 const int NUM_LANES = 5;
 const int MAX_LEVEL = 100;
 const int TOP_K_SCORES = 10;
+const int NUM_SCENES = 8;
 const int FRAME_RATE = 60;
 const int FRAMES_PER_SEC = FRAME_RATE;
 
 // Score points required to gain a level (smaller = faster level ups)
 const int LEVEL_SCORE_INTERVAL = 150;
 
+// Upper bound on how long shutdown waits for queued score saves
+const double SHUTDOWN_FLUSH_SECONDS = 2.0;
+
+// Per-frame time allowed for uploading streamed assets on the main thread
+const double ASSET_UPLOAD_BUDGET_MS = 2.0;
+
+// Screens that don't animate (pause, game over, scores) drop to this
+// frame rate after this long without input
+const int IDLE_FPS = 15;
+const double IDLE_AFTER_SECONDS = 2.0;
+
+// Upper bound for --weather-density (multiplies rain, snow and star counts)
+const int MAX_WEATHER_DENSITY = 10;
+
+// Shared leaderboard daemon socket (main --leaderboard-daemon)
+const char *const LEADERBOARD_SOCKET = "traffic_leaderboard.sock";
+
+static const chrono::steady_clock::time_point processStart = chrono::steady_clock::now();
+static double msSinceStart() {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - processStart).count();
+}
+
 // -------------------- Enums & Structs --------------------
 enum GameState { MENU, PLAYING, PAUSED, GAME_OVER, SCORES };
 enum SceneType { CITY, HIGHWAY, DESERT, NIGHT, FOREST, SNOW, SUNSET, RAIN };
 enum PowerUpType { SHIELD, SLOW_MOTION, SCORE_MULTIPLIER, EXTRA_LIFE };
 
+struct GameOptions {
+    double uploadBudgetMs = ASSET_UPLOAD_BUDGET_MS;
+    string leaderboardSocket = LEADERBOARD_SOCKET;
+    int weatherDensity = 1;
+    float renderScale = 1.0f;       // world resolution relative to the window
+    bool autoRenderScale = false;
+    int qualityTier = 0;            // index into QUALITY_TIERS
+    bool autoQuality = true;
+    bool pipeline = true;           // overlap the next update with drawing
+};
+
 struct Position { float x, y; Position(float X=0, float Y=0): x(X), y(Y) {} };
 struct CollisionBox {
     float x,y,w,h;
@@ -115,595 +179,4402 @@ public:
     }
 };
 
-// -------------------- SceneManager --------------------
-class SceneManager {
+// -------------------- Futures & Continuations --------------------
+// Continuations never run on a worker: they are posted here and drained by
+// the main loop at the start of each frame, so they may touch game state.
+class FrameDispatcher {
+    vector<function<void()>> pending;
+    mutex mtx;
 public:
-    struct Building {
-        int x, width, height;
-        int cols, rows;
-        vector<vector<bool>> windows;
-    };
+    void post(function<void()> fn) {
+        lock_guard<mutex> lk(mtx);
+        pending.push_back(move(fn));
+    }
+    void drain() {
+        vector<function<void()>> run;
+        {
+            lock_guard<mutex> lk(mtx);
+            run.swap(pending);
+        }
+        for (auto &fn : run) fn();
+    }
+};
 
-private:
-    SceneType currentScene;
-    int sceneTimer;
-    float transitionAlpha;
-    bool transitioning;
-    vector<Building> buildings;
-    bool buildingsInitialized;
-    
-    // Background textures
-    Texture2D cityBg, highwayBg, desertBg, nightBg, forestBg, snowBg, sunsetBg, rainBg;
-    bool texturesLoaded;
+struct Unit {};
+template <typename T> struct FutureValue { typedef T type; };
+template <> struct FutureValue<void> { typedef Unit type; };
+
+// Calls fn(args...) and maps a void result to Unit
+template <typename R> struct InvokeInto {
+    template <typename F, typename... A> static R call(F &fn, A&&... args) { return fn(forward<A>(args)...); }
+};
+template <> struct InvokeInto<void> {
+    template <typename F, typename... A> static Unit call(F &fn, A&&... args) { fn(forward<A>(args)...); return Unit(); }
+};
+
+static string describeError(exception_ptr err) {
+    try {
+        if (err) rethrow_exception(err);
+    } catch (const exception &e) {
+        return e.what();
+    } catch (...) {}
+    return "unknown error";
+}
 
+template <typename T>
+struct FutureState {
+    mutex mtx;
+    condition_variable cv;
+    bool ready = false;
+    T value = T();
+    exception_ptr error;
+    vector<function<void()>> continuations;
+
+    void complete() {
+        vector<function<void()>> run;
+        {
+            lock_guard<mutex> lk(mtx);
+            ready = true;
+            run.swap(continuations);
+        }
+        cv.notify_all();
+        for (auto &fn : run) fn();
+    }
+};
+
+template <typename T>
+class Future {
+    template <typename> friend class Promise;
+    shared_ptr<FutureState<T>> st;
+    explicit Future(shared_ptr<FutureState<T>> s): st(move(s)) {}
+
+    void whenReady(function<void()> fn) {
+        {
+            lock_guard<mutex> lk(st->mtx);
+            if (!st->ready) { st->continuations.push_back(move(fn)); return; }
+        }
+        fn();
+    }
 public:
-    SceneManager()
-        : currentScene(CITY), sceneTimer(0), transitionAlpha(0),
-          transitioning(false), buildingsInitialized(false), texturesLoaded(false) {}
-    
-    ~SceneManager() {
-        unloadTextures();
+    Future() {}
+    bool valid() const { return (bool)st; }
+    bool isReady() const {
+        if (!st) return false;
+        lock_guard<mutex> lk(st->mtx);
+        return st->ready;
     }
-    
-    void loadTextures() {
-        if (texturesLoaded) return;
-        
-        // Try to load background images from URLs or local files
-        // For production, download these images and place them in assets folder
-        // Using placeholder approach with Image generation for now
-        
-        cityBg = loadTextureFromURL("https://images.unsplash.com/photo-1480714378408-67cf0d13bc1b?w=1000&h=650&fit=crop");
-        highwayBg = loadTextureFromURL("https://images.unsplash.com/photo-1449824913935-59a10b8d2000?w=1000&h=650&fit=crop");
-        desertBg = loadTextureFromURL("https://images.unsplash.com/photo-1509316785289-025f5b846b35?w=1000&h=650&fit=crop");
-        nightBg = loadTextureFromURL("https://images.unsplash.com/photo-1519681393784-d120267933ba?w=1000&h=650&fit=crop");
-        forestBg = loadTextureFromURL("https://images.unsplash.com/photo-1441974231531-c6227db76b6e?w=1000&h=650&fit=crop");
-        snowBg = loadTextureFromURL("https://images.unsplash.com/photo-1491002052546-bf38f186af56?w=1000&h=650&fit=crop");
-        sunsetBg = loadTextureFromURL("https://images.unsplash.com/photo-1495567720989-cebdbdd97913?w=1000&h=650&fit=crop");
-        rainBg = loadTextureFromURL("https://images.unsplash.com/photo-1428908728789-d2de25dbd4e2?w=1000&h=650&fit=crop");
-        
-        texturesLoaded = true;
+    bool hasError() const {
+        if (!st) return false;
+        lock_guard<mutex> lk(st->mtx);
+        return st->ready && st->error;
     }
-    
-    Texture2D loadTextureFromURL(const char* url) {
-        // In a real implementation, you would download the image
-        // For now, create a simple gradient texture as fallback
-        Image img = GenImageGradientLinear(SCREEN_WIDTH, SCREEN_HEIGHT, 0, SKYBLUE, DARKBLUE);
-        Texture2D tex = LoadTextureFromImage(img);
-        UnloadImage(img);
-        return tex;
+    // Blocks up to `seconds`; returns whether the result is available.
+    bool waitFor(double seconds) const {
+        if (!st) return false;
+        unique_lock<mutex> lk(st->mtx);
+        return st->cv.wait_for(lk, chrono::duration<double>(seconds), [this]{ return st->ready; });
     }
-    
-    void unloadTextures() {
-        if (!texturesLoaded) return;
-        UnloadTexture(cityBg);
-        UnloadTexture(highwayBg);
-        UnloadTexture(desertBg);
-        UnloadTexture(nightBg);
-        UnloadTexture(forestBg);
-        UnloadTexture(snowBg);
-        UnloadTexture(sunsetBg);
-        UnloadTexture(rainBg);
-        texturesLoaded = false;
+    // Blocks until ready; rethrows the job's exception.
+    const T &get() const {
+        unique_lock<mutex> lk(st->mtx);
+        st->cv.wait(lk, [this]{ return st->ready; });
+        if (st->error) rethrow_exception(st->error);
+        return st->value;
     }
 
-    SceneType getCurrentScene() const { return currentScene; }
+    // Runs fn(value) on the main thread at the next frame boundary. If this
+    // future failed, fn is skipped and the error propagates to the result.
+    template <typename F>
+    Future<typename FutureValue<typename invoke_result<F, const T&>::type>::type> then(FrameDispatcher &disp, F fn);
 
-    void update() {
-        sceneTimer++;
-        if (sceneTimer > 1200) {
-            if (!transitioning) { transitioning = true; transitionAlpha = 0; }
+    // Runs fn(message) on the main thread if this future fails.
+    Future<T> onError(FrameDispatcher &disp, function<void(const string&)> fn) {
+        shared_ptr<FutureState<T>> s = st;
+        whenReady([s, &disp, fn]() {
+            if (s->error) disp.post([s, fn]() { fn(describeError(s->error)); });
+        });
+        return *this;
+    }
+};
+
+template <typename T>
+class Promise {
+    shared_ptr<FutureState<T>> st;
+public:
+    Promise(): st(make_shared<FutureState<T>>()) {}
+    Future<T> future() const { return Future<T>(st); }
+    void setValue(T v) {
+        {
+            lock_guard<mutex> lk(st->mtx);
+            st->value = move(v);
         }
-        if (transitioning) {
-            transitionAlpha += 0.02f;
-            if (transitionAlpha >= 1.0f) {
-                currentScene = (SceneType)(((int)currentScene + 1) % 8);
-                sceneTimer = 0;
-                transitioning = false;
-                transitionAlpha = 0;
-                buildingsInitialized = false;
-            }
+        st->complete();
+    }
+    void setError(exception_ptr err) {
+        {
+            lock_guard<mutex> lk(st->mtx);
+            st->error = err;
         }
+        st->complete();
     }
+};
 
-    Color getRoadColor() const {
-        switch(currentScene) {
-            case CITY: return DARKGRAY;
-            case HIGHWAY: return (Color){50,50,50,255};
-            case DESERT: return (Color){139,90,43,255};
-            case NIGHT: return (Color){30,30,40,255};
-            case FOREST: return (Color){60,70,50,255};
-            case SNOW: return (Color){200,200,220,255};
-            case SUNSET: return (Color){80,60,50,255};
-            case RAIN: return (Color){40,40,45,255};
-            default: return DARKGRAY;
+template <typename T>
+template <typename F>
+Future<typename FutureValue<typename invoke_result<F, const T&>::type>::type> Future<T>::then(FrameDispatcher &disp, F fn) {
+    typedef typename invoke_result<F, const T&>::type R;
+    typedef typename FutureValue<R>::type U;
+    Promise<U> next;
+    shared_ptr<FutureState<T>> s = st;
+    whenReady([s, &disp, fn, next]() {
+        disp.post([s, fn, next]() mutable {
+            if (s->error) { next.setError(s->error); return; }
+            try {
+                next.setValue(InvokeInto<R>::call(fn, (const T&)s->value));
+            } catch (...) {
+                next.setError(current_exception());
+            }
+        });
+    });
+    return next.future();
+}
+
+// -------------------- Work-stealing Job Queue --------------------
+// Tagged streams run their jobs one at a time in submission order (FIFO),
+// so e.g. two quick score saves can never land on disk out of order.
+enum JobStream { JOB_STREAM_SCORES, JOB_STREAM_HISTORY, JOB_STREAM_COMPACTION, JOB_STREAM_LEADERBOARD, JOB_STREAM_COUNT };
+
+class JobQueue {
+    struct Worker {
+        deque<function<void()>> jobs;
+        mutex mtx;
+    };
+    struct Stream {
+        deque<function<void()>> pending;
+        bool active = false;
+    };
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    Stream streams[JOB_STREAM_COUNT];
+    mutex streamMtx;
+    mutex sleepMtx;
+    condition_variable cv;
+    atomic<bool> running;
+    atomic<bool> joined;
+    atomic<int> queued;
+    atomic<int> sleepers;
+    atomic<unsigned> nextWorker;
+
+    static int &workerIndex() { static thread_local int idx = -1; return idx; }
+
+    // Fire-and-forget jobs have nobody to report to, so failures are logged;
+    // use submit() when the caller needs to know.
+    static void runGuarded(const function<void()> &job) {
+        try {
+            if (job) job();
+        } catch (...) {
+            TraceLog(LOG_WARNING, "JOBS: Unhandled exception in job: %s", describeError(current_exception()).c_str());
         }
     }
 
-    Color getSkyColor() const {
-        switch(currentScene) {
-            case CITY: return SKYBLUE;
-            case HIGHWAY: return (Color){135,206,235,255};
-            case DESERT: return (Color){255,200,124,255};
-            case NIGHT: return (Color){25,25,50,255};
-            case FOREST: return (Color){100,180,100,255};
-            case SNOW: return (Color){220,230,240,255};
-            case SUNSET: return (Color){255,140,90,255};
-            case RAIN: return (Color){80,90,100,255};
-            default: return SKYBLUE;
+    bool tryPop(int self, function<void()> &out) {
+        int n = (int)workers.size();
+        // Own deque first (front = oldest), then steal from the back of the others
+        for (int k = 0; k < n; ++k) {
+            int w = (self + k) % n;
+            Worker &wk = *workers[w];
+            lock_guard<mutex> lk(wk.mtx);
+            if (wk.jobs.empty()) continue;
+            if (k == 0) { out = move(wk.jobs.front()); wk.jobs.pop_front(); }
+            else { out = move(wk.jobs.back()); wk.jobs.pop_back(); }
+            queued--;
+            return true;
         }
+        return false;
     }
 
-    Color getLineColor() const {
-        switch(currentScene) {
-            case CITY: return YELLOW;
-            case HIGHWAY: return WHITE;
-            case DESERT: return (Color){255,255,150,255};
-            case NIGHT: return (Color){255,255,100,255};
-            case FOREST: return (Color){255,255,200,255};
-            case SNOW: return (Color){255,200,0,255};
-            case SUNSET: return (Color){255,220,150,255};
-            case RAIN: return (Color){200,200,255,255};
-            default: return YELLOW;
+    void workerLoop(int self) {
+        workerIndex() = self;
+        while (true) {
+            function<void()> job;
+            if (tryPop(self, job)) {
+                runGuarded(job);
+                continue;
+            }
+            unique_lock<mutex> lk(sleepMtx);
+            sleepers++;
+            cv.wait(lk, [this]{ return queued.load() > 0 || !running; });
+            sleepers--;
+            if (!running && queued.load() == 0) break;
         }
     }
 
-    const char* getSceneName() const {
-        switch(currentScene) {
-            case CITY: return "CITY";
-            case HIGHWAY: return "HIGHWAY";
-            case DESERT: return "DESERT";
-            case NIGHT: return "NIGHT";
-            case FOREST: return "FOREST";
-            case SNOW: return "SNOW";
-            case SUNSET: return "SUNSET";
-            case RAIN: return "RAIN";
-            default: return "UNKNOWN";
+    void enqueue(function<void()> job) {
+        if (joined) { job(); return; }
+        // Jobs pushed from a worker stay on its own deque; others round-robin
+        int self = workerIndex();
+        int w = self >= 0 ? self : (int)(nextWorker++ % workers.size());
+        {
+            lock_guard<mutex> lk(workers[w]->mtx);
+            workers[w]->jobs.push_back(move(job));
+        }
+        queued++;
+        // Only pay for the wake-up when some worker is actually parked
+        if (sleepers.load() > 0) {
+            { lock_guard<mutex> lk(sleepMtx); }
+            cv.notify_one();
         }
     }
 
-    void generateCityBuildings() {
-        buildings.clear();
-        int num = 6;
-        int spacing = SCREEN_WIDTH / num;
-        unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)sceneTimer;
-        for (int i = 0; i < num; ++i) {
-            int x = i * spacing + (seed % 15) - 7 + (i*3);
-            int height = 120 + ((seed + i*37) % 200);
-            int width = 140;
-            Building b;
-            b.x = x;
-            b.width = width;
-            b.height = height;
-            b.cols = 5 + ((seed + i) % 3);
-            b.rows = max(4, b.height / 30);
-            b.windows.assign(b.rows, vector<bool>(b.cols, false));
-            unsigned int s2 = seed + i*123;
-            for (int r=0; r<b.rows; ++r) {
-                for (int c=0; c<b.cols; ++c) {
-                    unsigned int v = (s2 * (r+3) * (c+7) + 73) % 10;
-                    b.windows[r][c] = (v >= 3);
-                }
+    void runStream(JobStream tag, function<void()> job) {
+        enqueue([this, tag, job]() {
+            runGuarded(job);
+            function<void()> next;
+            {
+                lock_guard<mutex> lk(streamMtx);
+                Stream &s = streams[tag];
+                if (s.pending.empty()) { s.active = false; return; }
+                next = move(s.pending.front());
+                s.pending.pop_front();
             }
-            buildings.push_back(b);
-        }
-        buildingsInitialized = true;
+            runStream(tag, move(next));
+        });
     }
 
-    void drawBackground() {
-        if (getCurrentScene() == CITY && !buildingsInitialized) generateCityBuildings();
+    template <typename F, typename Sink>
+    Future<typename FutureValue<typename invoke_result<F>::type>::type> submitTo(F fn, Sink sink) {
+        typedef typename invoke_result<F>::type R;
+        Promise<typename FutureValue<R>::type> p;
+        sink([fn, p]() mutable {
+            try {
+                p.setValue(InvokeInto<R>::call(fn));
+            } catch (...) {
+                p.setError(current_exception());
+            }
+        });
+        return p.future();
+    }
 
-        Color sky = getSkyColor();
-        
-        // Draw gradient sky background
-        for (int i = 0; i < SCREEN_HEIGHT/2; ++i) {
-            float a = (float)i / (SCREEN_HEIGHT/2);
-            Color grad = ColorAlpha(sky, 1.0f - a*0.3f);
-            DrawRectangle(0, i, SCREEN_WIDTH, 1, grad);
+public:
+    explicit JobQueue(unsigned threadCount = 0): running(true), joined(false), queued(0), sleepers(0), nextWorker(0) {
+        if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+        for (unsigned i = 0; i < threadCount; ++i) workers.push_back(unique_ptr<Worker>(new Worker()));
+        for (unsigned i = 0; i < threadCount; ++i) threads.push_back(thread([this, i]{ workerLoop((int)i); }));
+    }
+    ~JobQueue() {
+        shutdown();
+    }
+    int threadCount() const { return (int)workers.size(); }
+    void push(function<void()> job) {
+        enqueue(move(job));
+    }
+    // Runs after every job previously pushed to the same stream has finished.
+    void push(JobStream tag, function<void()> job) {
+        {
+            lock_guard<mutex> lk(streamMtx);
+            Stream &s = streams[tag];
+            if (s.active) { s.pending.push_back(move(job)); return; }
+            s.active = true;
+        }
+        runStream(tag, move(job));
+    }
+    // Runs fn on the pool; its result or exception is delivered via the future.
+    template <typename F>
+    Future<typename FutureValue<typename invoke_result<F>::type>::type> submit(F fn) {
+        return submitTo(fn, [this](function<void()> job){ push(move(job)); });
+    }
+    template <typename F>
+    Future<typename FutureValue<typename invoke_result<F>::type>::type> submit(JobStream tag, F fn) {
+        return submitTo(fn, [this, tag](function<void()> job){ push(tag, move(job)); });
+    }
+    // Drains everything still queued (including stream backlogs), then joins.
+    void shutdown() {
+        if (running.exchange(false)) {
+            { lock_guard<mutex> lk(sleepMtx); }
+            cv.notify_all();
+            for (auto &t : threads) if (t.joinable()) t.join();
+            joined = true;
         }
+    }
+};
 
-        DrawRectangle(0, (int)(SCREEN_HEIGHT * 0.5f), SCREEN_WIDTH, (int)(SCREEN_HEIGHT * 0.5f), Fade(getRoadColor(), 0.5f));
+// -------------------- Asset Streamer --------------------
+// Decoding (file reads, audio decode) happens on the pool;
+// only the GPU/audio-device upload runs on the main thread, a few per frame
+// within a time budget. Callers get a future that resolves after upload.
+class AssetStreamer {
+    JobQueue &pool;
+    mutex mtx;
+    deque<function<void()>> uploads;   // main-thread half of each request
+    atomic<int> inFlight;
+    double budgetMs;
+    vector<Sound> sounds;
+    vector<Music> musics;
+    vector<unsigned char*> musicData;  // LoadMusicStreamFromMemory streams from this buffer
 
-        // Scene-specific elements
-        if (getCurrentScene() == CITY) {
-            for (const Building &b : buildings) {
-                DrawRectangle(b.x, (int)(SCREEN_HEIGHT * 0.5f) - b.height, b.width, b.height, GRAY);
-                int wx = b.x + 10;
-                int wy = (int)(SCREEN_HEIGHT * 0.5f) - b.height + 10;
-                int cellW = (b.width - 20) / b.cols;
-                int cellH = (b.height - 20) / b.rows;
-                for (int r=0; r<b.rows; ++r) {
-                    for (int c=0; c<b.cols; ++c) {
-                        if (b.windows[r][c]) {
-                            DrawRectangle(wx + c * cellW + 2, wy + r * cellH + 2, cellW - 4, cellH - 6, Fade(LIGHTGRAY, 0.9f));
-                        } else {
-                            DrawRectangleLines(wx + c * cellW + 2, wy + r * cellH + 2, cellW - 4, cellH - 6, Fade(DARKGRAY, 0.6f));
-                        }
-                    }
-                }
-            }
-        } else if (getCurrentScene() == DESERT) {
-            // Sun
-            DrawCircle(SCREEN_WIDTH - 100, 100, 50, ORANGE);
-            DrawCircle(SCREEN_WIDTH - 100, 100, 60, Fade(ORANGE, 0.25f));
-            // Sand dunes
-            for (int i = 0; i < 5; i++) {
-                DrawCircle(i * 250 + 100, (int)(SCREEN_HEIGHT * 0.5f) - 20, 80, Fade((Color){210, 180, 140, 255}, 0.6f));
-            }
-            // Cacti
-            DrawRectangle(150, (int)(SCREEN_HEIGHT * 0.5f) - 80, 20, 80, (Color){34, 139, 34, 255});
-            DrawRectangle(135, (int)(SCREEN_HEIGHT * 0.5f) - 50, 30, 15, (Color){34, 139, 34, 255});
-            DrawRectangle(700, (int)(SCREEN_HEIGHT * 0.5f) - 70, 18, 70, (Color){34, 139, 34, 255});
-        } else if (getCurrentScene() == NIGHT) {
-            // Moon
-            DrawCircle(100, 80, 30, Fade(WHITE, 0.8f));
-            DrawCircle(110, 75, 28, Fade((Color){25, 25, 50, 255}, 1.0f));
-            // Stars
-            for (int i=0;i<30;i++){
-                int x=(i*123)%SCREEN_WIDTH;
-                int y=(i*456)%300;
-                DrawCircle(x,y,2,WHITE);
-            }
-        } else if (getCurrentScene() == FOREST) {
-            // Trees in background
-            for (int i = 0; i < 8; i++) {
-                int x = i * 130 + 50;
-                int h = 100 + (i * 17) % 50;
-                DrawTriangle(
-                    (Vector2){(float)x, (float)(SCREEN_HEIGHT * 0.5f) - h},
-                    (Vector2){(float)(x - 40), (float)(SCREEN_HEIGHT * 0.5f)},
-                    (Vector2){(float)(x + 40), (float)(SCREEN_HEIGHT * 0.5f)},
-                    (Color){34, 139, 34, 200}
-                );
-                DrawRectangle(x - 10, (int)(SCREEN_HEIGHT * 0.5f) - h/3, 20, h/3, (Color){101, 67, 33, 255});
-            }
-            // Birds
-            for (int i = 0; i < 5; i++) {
-                int x = (i * 200 + sceneTimer) % SCREEN_WIDTH;
-                int y = 50 + (i * 30) % 100;
-                DrawText("^", x, y, 20, Fade(BLACK, 0.3f));
-            }
-        } else if (getCurrentScene() == SNOW) {
-            // Mountains
-            DrawTriangle(
-                (Vector2){200, (float)(SCREEN_HEIGHT * 0.5f)},
-                (Vector2){100, (float)(SCREEN_HEIGHT * 0.5f)},
-                (Vector2){150, (float)(SCREEN_HEIGHT * 0.5f) - 120},
-                (Color){200, 200, 220, 255}
-            );
-            DrawTriangle(
-                (Vector2){400, (float)(SCREEN_HEIGHT * 0.5f)},
-                (Vector2){250, (float)(SCREEN_HEIGHT * 0.5f)},
-                (Vector2){325, (float)(SCREEN_HEIGHT * 0.5f) - 150},
-                (Color){220, 220, 240, 255}
-            );
-            DrawTriangle(
-                (Vector2){900, (float)(SCREEN_HEIGHT * 0.5f)},
-                (Vector2){700, (float)(SCREEN_HEIGHT * 0.5f)},
-                (Vector2){800, (float)(SCREEN_HEIGHT * 0.5f) - 130},
-                (Color){210, 210, 230, 255}
-            );
-            // Falling snow
-            for (int i = 0; i < 50; i++) {
-                int x = (i * 77 + sceneTimer) % SCREEN_WIDTH;
-                int y = (i * 93 + sceneTimer * 2) % SCREEN_HEIGHT;
-                DrawCircle(x, y, 2, WHITE);
-            }
-        } else if (getCurrentScene() == SUNSET) {
-            // Large sun on horizon
-            DrawCircle((int)(SCREEN_WIDTH * 0.5f), (int)(SCREEN_HEIGHT * 0.5f) - 50, 80, (Color){255, 140, 0, 200});
-            DrawCircle((int)(SCREEN_WIDTH * 0.5f), (int)(SCREEN_HEIGHT * 0.5f) - 50, 100, Fade((Color){255, 100, 0, 255}, 0.3f));
-            // Clouds
-            for (int i = 0; i < 4; i++) {
-                int x = i * 250 + 50;
-                int y = 100 + (i * 30) % 80;
-                DrawCircle(x, y, 30, Fade((Color){255, 180, 120, 255}, 0.6f));
-                DrawCircle(x + 30, y, 25, Fade((Color){255, 180, 120, 255}, 0.5f));
-                DrawCircle(x - 20, y + 10, 20, Fade((Color){255, 180, 120, 255}, 0.4f));
-            }
-        } else if (getCurrentScene() == RAIN) {
-            // Dark clouds
-            for (int i = 0; i < 6; i++) {
-                int x = i * 180 + (sceneTimer/2) % 180;
-                int y = 50 + (i * 20) % 60;
-                DrawCircle(x, y, 40, Fade((Color){60, 70, 80, 255}, 0.7f));
-                DrawCircle(x + 30, y, 35, Fade((Color){60, 70, 80, 255}, 0.6f));
-            }
-            // Rain drops
-            for (int i = 0; i < 100; i++) {
-                int x = (i * 53) % SCREEN_WIDTH;
-                int y = (i * 71 + sceneTimer * 8) % SCREEN_HEIGHT;
-                DrawLine(x, y, x + 2, y + 10, Fade((Color){150, 180, 200, 255}, 0.5f));
+    void queueUpload(function<void()> fn) {
+        lock_guard<mutex> lk(mtx);
+        uploads.push_back(move(fn));
+    }
+
+    // Pool half: decode, then hand the upload closure to the main thread.
+    // A failed decode still queues a closure so the error lands on the main thread.
+    template <typename Decoded, typename T>
+    Future<T> stream(function<Decoded()> decode, function<T(Decoded&)> upload) {
+        Promise<T> p;
+        inFlight++;
+        pool.push([this, decode, upload, p]() mutable {
+            shared_ptr<Decoded> d;
+            exception_ptr err;
+            try {
+                d = make_shared<Decoded>(decode());
+            } catch (...) {
+                err = current_exception();
             }
-        }
+            queueUpload([this, d, err, upload, p]() mutable {
+                inFlight--;
+                if (err) { p.setError(err); return; }
+                try {
+                    p.setValue(upload(*d));
+                } catch (...) {
+                    p.setError(current_exception());
+                }
+            });
+        });
+        return p.future();
     }
-};
 
-// -------------------- Car --------------------
-class Car {
-private:
-    Position pos;
-    Position target;
-    float speed;
-    int lane;
-    Color color;
-    bool isPlayer;
-    float smooth;
 public:
-    Car(float x, float y, int laneIdx, float spd, Color c, bool player=false)
-        : pos(x,y), target(x,y), speed(spd), lane(laneIdx), color(c), isPlayer(player), smooth(0.15f) {}
-    void update(float speedMultiplier = 1.0f) {
-        if (!isPlayer) pos.y += speed * speedMultiplier;
-        else { pos.x += (target.x - pos.x) * smooth; pos.y += (target.y - pos.y) * smooth; }
+    AssetStreamer(JobQueue &jobs, double uploadBudgetMs)
+        : pool(jobs), inFlight(0), budgetMs(uploadBudgetMs) {}
+
+    void setUploadBudget(double ms) { budgetMs = ms; }
+    int pending() const { return inFlight.load(); }
+
+    Future<Sound> requestSound(const string &path) {
+        return stream<Wave, Sound>([path]() {
+            if (!FileExists(path.c_str())) throw runtime_error("missing " + path);
+            Wave w = LoadWave(path.c_str());
+            if (w.data == nullptr) throw runtime_error("cannot decode " + path);
+            return w;
+        }, [this](Wave &w) {
+            Sound snd = LoadSoundFromWave(w);
+            UnloadWave(w);
+            sounds.push_back(snd);
+            return snd;
+        });
     }
-    void draw() const {
-        DrawEllipse(pos.x, pos.y + 45, 30, 10, Fade(BLACK, 0.3f));
-        DrawRectangle(pos.x - 30, pos.y - 50, 60, 100, color);
-        DrawRectangleGradientV(pos.x - 30, pos.y - 50, 60, 40, Fade(WHITE,0.2f), Fade(BLACK,0.0f));
-        if (isPlayer) {
-            DrawRectangle(pos.x - 30, pos.y - 60, 60, 20, Fade(color, 0.8f));
-            DrawTriangle((Vector2){pos.x, pos.y - 60}, (Vector2){pos.x - 30, pos.y - 40}, (Vector2){pos.x + 30, pos.y - 40}, RED);
-            DrawRectangle(pos.x - 5, pos.y - 50, 10, 100, Fade(WHITE,0.7f));
+
+    Future<Music> requestMusic(const string &path) {
+        struct Bytes { unsigned char *data = nullptr; int size = 0; };
+        return stream<Bytes, Music>([path]() {
+            Bytes b;
+            if (FileExists(path.c_str())) b.data = LoadFileData(path.c_str(), &b.size);
+            if (b.data == nullptr) throw runtime_error("cannot read " + path);
+            return b;
+        }, [this, path](Bytes &b) {
+            Music m = LoadMusicStreamFromMemory(GetFileExtension(path.c_str()), b.data, b.size);
+            musicData.push_back(b.data);
+            musics.push_back(m);
+            return m;
+        });
+    }
+
+    // Main thread, once per frame. Always performs at least one upload so
+    // a single oversized asset cannot stall streaming forever.
+    int pump() {
+        auto t0 = chrono::steady_clock::now();
+        int done = 0;
+        while (true) {
+            function<void()> fn;
+            {
+                lock_guard<mutex> lk(mtx);
+                if (uploads.empty()) break;
+                fn = move(uploads.front());
+                uploads.pop_front();
+            }
+            fn();
+            done++;
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            if (ms >= budgetMs) break;
         }
-        Color wc = {100,150,200,200};
-        DrawRectangle(pos.x-22, pos.y-30, 44, 25, wc);
-        DrawRectangle(pos.x-22, pos.y-30, 44, 5, Fade(WHITE, 0.5f));
-        Rectangle w1 = {pos.x - 35, pos.y - 35, 12, 20};
-        Rectangle w2 = {pos.x + 23, pos.y - 35, 12, 20};
-        Rectangle w3 = {pos.x - 35, pos.y + 15, 12, 20};
-        Rectangle w4 = {pos.x + 23, pos.y + 15, 12, 20};
-        DrawRectangleRounded(w1, 0.3f, 6, DARKGRAY);
-        DrawRectangleRounded(w2, 0.3f, 6, DARKGRAY);
-        DrawRectangleRounded(w3, 0.3f, 6, DARKGRAY);
-        DrawRectangleRounded(w4, 0.3f, 6, DARKGRAY);
-        if (isPlayer) {
-            DrawRectangle(pos.x - 25, pos.y + 45, 18, 6, YELLOW);
-            DrawRectangle(pos.x + 7, pos.y + 45, 18, 6, YELLOW);
-            DrawCircle(pos.x - 16, pos.y + 48, 4, Fade(YELLOW,0.6f));
-            DrawCircle(pos.x + 16, pos.y + 48, 4, Fade(YELLOW,0.6f));
-        } else {
-            DrawRectangle(pos.x - 25, pos.y - 48, 18, 6, RED);
-            DrawRectangle(pos.x + 7, pos.y - 48, 18, 6, RED);
+        return done;
+    }
+
+    // Main thread; the pool must be drained first so no decode is in flight.
+    // Uploads still queued are run regardless of the budget, so everything
+    // they load is owned here and unloaded below.
+    void unloadAll() {
+        while (true) {
+            function<void()> fn;
+            {
+                lock_guard<mutex> lk(mtx);
+                if (uploads.empty()) break;
+                fn = move(uploads.front());
+                uploads.pop_front();
+            }
+            fn();
         }
+        for (auto &snd : sounds) { StopSound(snd); UnloadSound(snd); }
+        for (auto &m : musics) { StopMusicStream(m); UnloadMusicStream(m); }
+        for (auto d : musicData) UnloadFileData(d);
+        sounds.clear(); musics.clear(); musicData.clear();
     }
-    CollisionBox box() const { return { pos.x - 30, pos.y - 50, 60, 100 }; }
-    Position getPos() const { return pos; }
-    int getLane() const { return lane; }
-    void setLane(int l) { lane = l; }
-    void setPos(float x, float y) { pos.x = x; pos.y = y; }
-    void setTarget(float x, float y) { target.x = x; target.y = y; }
-    void setSpeed(float s) { speed = s; }
 };
 
-// -------------------- PowerUp --------------------
-class PowerUp {
+// -------------------- Render Texture Baking --------------------
+// Drawing translucent shapes into a render texture with the usual blend
+// would also blend its alpha channel, so the texture comes out partly
+// transparent and blends a second time when drawn. These keep it right.
+
+// For layers cleared to an opaque colour: colour blends as usual, alpha
+// stays 1, so a plain blit matches drawing directly.
+static void beginOpaqueBake() {
+    rlSetBlendFactorsSeparate(RL_SRC_ALPHA, RL_ONE_MINUS_SRC_ALPHA, RL_ONE, RL_ONE, RL_FUNC_ADD, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+}
+
+// For sprites cleared to BLANK: colour blends and alpha accumulates, which
+// leaves the texture premultiplied. Draw it with BLEND_ALPHA_PREMULTIPLY.
+static void beginPremultipliedBake() {
+    rlSetBlendFactorsSeparate(RL_SRC_ALPHA, RL_ONE_MINUS_SRC_ALPHA, RL_ONE, RL_ONE_MINUS_SRC_ALPHA, RL_FUNC_ADD, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+}
+
+// Draws a render texture's contents upright (they are stored bottom-up).
+static void drawRenderTexture(const RenderTexture2D &rt, float x, float y, Color tint = WHITE) {
+    DrawTextureRec(rt.texture, (Rectangle){0, 0, (float)rt.texture.width, -(float)rt.texture.height}, (Vector2){x, y}, tint);
+}
+
+// Stretches a render texture over `dst`, replacing what is there: layers
+// drawn with mixed blend modes can end up with alpha below 1.
+static void drawRenderTextureOpaque(const RenderTexture2D &rt, Rectangle dst) {
+    rlSetBlendFactors(RL_ONE, RL_ZERO, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM);
+    DrawTexturePro(rt.texture, (Rectangle){0, 0, (float)rt.texture.width, -(float)rt.texture.height}, dst, (Vector2){0, 0}, 0, WHITE);
+    EndBlendMode();
+}
+
+// -------------------- Renderer --------------------
+// Everything the world is drawn with goes through a Renderer: the scene
+// layers, road, cars and particles issue their primitives, blits and rlgl
+// batches here instead of calling raylib, and bake their layers through it
+// too. RaylibRenderer (below) is the screen; the others need no window, so
+// draw calls can be counted by walking the same code the screen runs.
+struct SceneFrame;
+class Car;
+
+class Renderer {
+public:
+    virtual ~Renderer() {}
+    virtual void beginFrame() {}
+    virtual void endFrame() {}
+
+    virtual void beginWorld(Vector2 shake) = 0;
+    virtual void endWorld() = 0;
+    virtual void background(const SceneFrame &f) = 0;
+    virtual void road(float offset, Color road, Color line) = 0;
+    virtual void cars(const Car *c, size_t n) = 0;
+    virtual void particles(const float *x, const float *y, const float *r, const Color *c, int n) = 0;
+
+    // Offscreen layers; see Render Texture Baking for the two blend setups.
+    virtual RenderTexture2D loadTarget(int w, int h, bool repeat) = 0;
+    virtual void unloadTarget(RenderTexture2D &rt) = 0;
+    virtual void beginTarget(const RenderTexture2D &rt, Color clear, bool premultiplied) = 0;
+    virtual void endTarget() = 0;
+    virtual void texture(const RenderTexture2D &rt, float x, float y, Color tint, bool premultiplied) = 0;
+
+    // A batch of `n` quads the caller emits through rlgl itself. Returns
+    // false when it should not (the backend has no GPU and only counts it).
+    virtual bool quads(int n) = 0;
+
+    virtual void rectangle(int x, int y, int w, int h, Color c) = 0;
+    virtual void rectangleGradientV(int x, int y, int w, int h, Color top, Color bottom) = 0;
+    virtual void rectangleGradientH(int x, int y, int w, int h, Color left, Color right) = 0;
+    virtual void rectangleLines(int x, int y, int w, int h, Color c) = 0;
+    virtual void rectanglePro(Rectangle r, Vector2 origin, float rotation, Color c) = 0;
+    virtual void rectangleRounded(Rectangle r, float roundness, int segments, Color c) = 0;
+    virtual void rectangleRoundedLines(Rectangle r, float roundness, int segments, Color c) = 0;
+    virtual void circle(int x, int y, float radius, Color c) = 0;
+    virtual void circleLines(int x, int y, float radius, Color c) = 0;
+    virtual void ellipse(int x, int y, float rx, float ry, Color c) = 0;
+    virtual void triangle(Vector2 a, Vector2 b, Vector2 c, Color col) = 0;
+    virtual void line(int x0, int y0, int x1, int y1, Color c) = 0;
+    virtual void text(const char *s, int x, int y, int size, Color c) = 0;
+
+protected:
+    // For backends without a GPU: a target nothing will ever bind, so
+    // layers "bake" and are then drawn as blits like on screen.
+    static RenderTexture2D placeholderTarget(int w, int h) {
+        static unsigned int nextId = 0;
+        RenderTexture2D rt = RenderTexture2D();
+        rt.id = rt.texture.id = ++nextId;
+        rt.texture.width = w;
+        rt.texture.height = h;
+        return rt;
+    }
+};
+
+// -------------------- Render Scale --------------------
+// The world (background, road, cars, particles) can be drawn into an
+// offscreen target smaller than the window and stretched up with bilinear
+// filtering; the HUD, menus and overlays stay at native resolution. In auto
+// mode the quality governor moves the scale once the other knobs are spent.
+static const float RENDER_SCALE_STEPS[] = { 1.0f, 0.85f, 0.75f, 0.6f, 0.5f };
+static const int NUM_RENDER_SCALE_STEPS = sizeof(RENDER_SCALE_STEPS) / sizeof(RENDER_SCALE_STEPS[0]);
+
+class RenderScaler {
+    RenderTexture2D target;
+    int step;               // index into RENDER_SCALE_STEPS
+    bool autoScale;
+    bool failed;
+    bool drawing;           // between begin() and end()
+    bool camera;            // a 2D camera is active for this pass
+
+public:
+    RenderScaler(): target(), step(0), autoScale(false), failed(false), drawing(false), camera(false) {}
+
+    // Snaps to the nearest step.
+    void configure(float scale, bool autoMode) {
+        int best = 0;
+        for (int i = 1; i < NUM_RENDER_SCALE_STEPS; ++i)
+            if (fabsf(RENDER_SCALE_STEPS[i] - scale) < fabsf(RENDER_SCALE_STEPS[best] - scale)) best = i;
+        step = autoMode ? 0 : best;
+        autoScale = autoMode;
+        TraceLog(LOG_INFO, "RENDER: World scale %.2f%s", this->scale(), autoMode ? " (auto)" : "");
+    }
+
+    float scale() const { return RENDER_SCALE_STEPS[step]; }
+    bool isAuto() const { return autoScale && !failed; }
+    void setStep(int s) { step = max(0, min(s, NUM_RENDER_SCALE_STEPS - 1)); }
+
+    // Starts the world pass; `shake` offsets it like the camera shake did.
+    void begin(Vector2 shake) {
+        drawing = !failed && step > 0;
+        if (drawing && (target.id == 0 || target.texture.width != targetWidth())) {
+            if (target.id != 0) UnloadRenderTexture(target);
+            target = LoadRenderTexture(targetWidth(), targetHeight());
+            if (target.id == 0) {
+                TraceLog(LOG_WARNING, "RENDER: No render texture for the scaled world; drawing at native resolution");
+                failed = true;
+                drawing = false;
+            } else {
+                SetTextureFilter(target.texture, TEXTURE_FILTER_BILINEAR);
+            }
+        }
+        float s = drawing ? scale() : 1.0f;
+        if (drawing) {
+            BeginTextureMode(target);
+            ClearBackground(RAYWHITE);
+        }
+        // The offset is in target pixels, so it shrinks with the zoom and the
+        // shake comes out the same size in window pixels at every scale
+        camera = drawing || shake.x != 0 || shake.y != 0;
+        if (camera) BeginMode2D(Camera2D{{shake.x * s, shake.y * s}, {0, 0}, 0, s});
+    }
+
+    // Ends the world pass and stretches it over the window.
+    void end() {
+        if (camera) EndMode2D();
+        if (!drawing) return;
+        EndTextureMode();
+        drawRenderTextureOpaque(target, (Rectangle){0, 0, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT});
+        drawing = false;
+    }
+
+    void unload() {
+        if (target.id != 0) UnloadRenderTexture(target);
+        target = RenderTexture2D();
+    }
+
+private:
+    int targetWidth() const { return (int)ceilf(SCREEN_WIDTH * scale()); }
+    int targetHeight() const { return (int)ceilf(SCREEN_HEIGHT * scale()); }
+};
+
+// -------------------- Quality Governor --------------------
+// Watches the frame time of live frames and moves one quality level at a
+// time: first down the detail tiers (weather, particle cap, city depth
+// layers, camera shake), then, with --render-scale=auto, down the render
+// scale steps. It steps down when more than MAX_OVERRUNS of a WINDOW of
+// frames overrun the budget and tries a step up after RAISE_AFTER clean
+// frames; a step up that has to be undone doubles that wait, so it settles
+// instead of oscillating. Every decision is logged with the frame times
+// behind it, and a summary of time spent per level at exit. With a pinned
+// tier and --render-scale=auto, only the render scale steps move.
+struct QualityTier {
+    const char *name;
+    float weather;          // fraction of rain, snow and star particles
+    float particles;        // fraction of the particle pool effects may fill
+    int skylineDepths;      // city depth layers drawn, nearest first
+    float shake;            // camera shake intensity
+};
+
+static const QualityTier QUALITY_TIERS[] = {
+    { "high",   1.0f,  1.0f,    3, 1.0f },
+    { "medium", 0.5f,  0.25f,   2, 0.5f },
+    { "low",    0.25f, 0.0625f, 1, 0.0f },
+};
+static const int NUM_QUALITY_TIERS = sizeof(QUALITY_TIERS) / sizeof(QUALITY_TIERS[0]);
+
+class QualityGovernor {
+    bool enabled;
+    int level, levels;      // level = tier, then tier max + render scale step
+    int floor;              // highest level it may step up to
+    int pinned;             // fixed tier, or -1 when the tiers move too
+    int windowFrames, windowOverruns;
+    float windowSeconds;
+    int calmFrames, raiseAfter, probeWindows;
+    int stepsDown, stepsUp;
+    vector<uint64_t> framesAt;  // live frames seen at each level
+
+public:
+    static const int WINDOW = 30;               // frames per decision
+    static const int MAX_OVERRUNS = 4;          // per window before stepping down
+    static const int RAISE_AFTER = 180;         // clean frames before trying a step up
+    static const int MAX_RAISE_AFTER = 3600;
+    static const int PROBE_WINDOWS = 4;         // clean windows that confirm a step up
+    static constexpr float OVERRUN = 1.2f;      // frame time over budget that counts
+
+    QualityGovernor()
+        : enabled(false), level(0), levels(NUM_QUALITY_TIERS), floor(0), pinned(-1), windowFrames(0), windowOverruns(0), windowSeconds(0),
+          calmFrames(0), raiseAfter(RAISE_AFTER), probeWindows(0), stepsDown(0), stepsUp(0), framesAt(NUM_QUALITY_TIERS, 0) {}
+
+    // `tier` is where it starts (or stays, when not automatic).
+    void configure(int tier, bool autoMode, bool scaleSteps) {
+        tier = max(0, min(tier, NUM_QUALITY_TIERS - 1));
+        enabled = autoMode || scaleSteps;
+        levels = NUM_QUALITY_TIERS + (scaleSteps ? NUM_RENDER_SCALE_STEPS - 1 : 0);
+        framesAt.assign(levels, 0);
+        pinned = autoMode ? -1 : tier;
+        floor = autoMode ? 0 : NUM_QUALITY_TIERS - 1;   // pinned: scale step 0 and below
+        level = autoMode ? tier : floor;
+        if (autoMode) TraceLog(LOG_INFO, "QUALITY: Governor on, starting at %s%s", describe(level).c_str(),
+                               scaleSteps ? ", render scale after the detail tiers" : "");
+        else TraceLog(LOG_INFO, "QUALITY: Fixed at %s%s", describe(level).c_str(),
+                      scaleSteps ? ", governor on for the render scale" : "");
+    }
+
+    const QualityTier &tier() const { return QUALITY_TIERS[pinned >= 0 ? pinned : min(level, NUM_QUALITY_TIERS - 1)]; }
+    int scaleStep() const { return max(0, level - (NUM_QUALITY_TIERS - 1)); }
+
+    // One call per live frame with its measured duration; returns whether
+    // the level changed.
+    bool observe(float frameSeconds) {
+        framesAt[level]++;
+        if (!enabled) return false;
+        if (frameSeconds > OVERRUN / FRAME_RATE) windowOverruns++;
+        windowSeconds += frameSeconds;
+        if (++windowFrames < WINDOW) return false;
+        int overruns = windowOverruns;
+        float avgMs = 1000.0f * windowSeconds / WINDOW;
+        bool over = overruns > MAX_OVERRUNS, clean = overruns == 0;
+        windowFrames = windowOverruns = 0;
+        windowSeconds = 0;
+        if (over) {
+            calmFrames = 0;
+            if (probeWindows > 0) {     // the last step up did not hold
+                raiseAfter = min(raiseAfter * 2, MAX_RAISE_AFTER);
+                probeWindows = 0;
+            }
+            if (level + 1 >= levels) return false;
+            change(level + 1, overruns, avgMs);
+            stepsDown++;
+            return true;
+        }
+        if (probeWindows > 0 && clean && --probeWindows == 0) raiseAfter = RAISE_AFTER;
+        calmFrames = clean ? calmFrames + WINDOW : 0;
+        if (calmFrames < raiseAfter || level == floor || probeWindows > 0) return false;
+        calmFrames = 0;
+        probeWindows = PROBE_WINDOWS;
+        change(level - 1, overruns, avgMs);
+        stepsUp++;
+        return true;
+    }
+
+    void logSummary() const {
+        uint64_t total = 0;
+        for (uint64_t f : framesAt) total += f;
+        if (total == 0) return;
+        string spent;
+        for (int i = 0; i < levels; ++i) {
+            if (framesAt[i] == 0) continue;
+            spent += TextFormat("%s%s %.0f%%", spent.empty() ? "" : ", ", describe(i).c_str(), 100.0 * framesAt[i] / total);
+        }
+        TraceLog(LOG_INFO, "QUALITY: %llu live frames: %s; %d steps down, %d up, ended at %s",
+                 (unsigned long long)total, spent.c_str(), stepsDown, stepsUp, describe(level).c_str());
+    }
+
+private:
+    string describe(int lvl) const {
+        int t = pinned >= 0 ? pinned : min(lvl, NUM_QUALITY_TIERS - 1), s = max(0, lvl - (NUM_QUALITY_TIERS - 1));
+        if (s == 0) return QUALITY_TIERS[t].name;
+        return TextFormat("%s @ %.2fx", QUALITY_TIERS[t].name, RENDER_SCALE_STEPS[s]);
+    }
+
+    void change(int to, int overruns, float avgMs) {
+        TraceLog(LOG_INFO, "QUALITY: %s -> %s (%d of %d frames over %.1f ms, avg %.1f ms)",
+                 describe(level).c_str(), describe(to).c_str(), overruns, WINDOW, 1000.0f * OVERRUN / FRAME_RATE, avgMs);
+        level = to;
+    }
+};
+
+// -------------------- Weather Batch --------------------
+// Rain, snow, birds and stars: every particle's position is a pure function
+// of its index and the scene timer, x = (i*dx + t*vx) mod w, so a frame's
+// positions are laid out in one pass over flat arrays (four lanes at a time
+// with SSE2) and submitted as a single quad batch through rlgl instead of
+// one raylib call per particle.
+struct WeatherPattern {
+    float dx, dy;   // spacing per particle index
+    float vx, vy;   // pixels per frame
+};
+
+class WeatherBatch {
+    vector<float> xs, ys;
+    int n;
+
+    static const int QUADS_PER_BATCH = 2048;  // stays well inside rlgl's default vertex buffer
+
+public:
+    WeatherBatch(): n(0) {}
+
+    void layout(int count, const WeatherPattern &p, int timer, float w, float h) {
+        n = count;
+        size_t padded = (size_t)(count + 3) & ~(size_t)3;
+        if (xs.size() < padded) { xs.resize(padded); ys.resize(padded); }
+        float t = (float)timer;
+        wrap(xs.data(), (int)padded, p.dx, t * p.vx, w);
+        wrap(ys.data(), (int)padded, p.dy, t * p.vy, h);
+    }
+
+    // out[i] = (i*step + offset) mod size; inputs stay small enough that
+    // float keeps them exact.
+    static void wrap(float *out, int count, float step, float offset, float size) {
+        offset = fmodf(offset, size);
+        float inv = 1.0f / size;
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128 vStep = _mm_set1_ps(step * 4.0f), vSize = _mm_set1_ps(size), vInv = _mm_set1_ps(inv), zero = _mm_setzero_ps();
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(step)), _mm_set1_ps(offset));
+        for (; i + 4 <= count; i += 4) {
+            __m128 q = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(v, vInv)));
+            __m128 x = _mm_sub_ps(v, _mm_mul_ps(q, vSize));
+            // The reciprocal can land one period off either way
+            x = _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(x, zero), vSize));
+            x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpge_ps(x, vSize), vSize));
+            _mm_storeu_ps(out + i, x);
+            v = _mm_add_ps(v, vStep);
+        }
+#endif
+        for (; i < count; ++i) {
+            float v = i * step + offset;
+            float x = v - (float)(int)(v * inv) * size;
+            if (x < 0) x += size;
+            if (x >= size) x -= size;
+            out[i] = x;
+        }
+    }
+
+    // Each particle becomes a w x h quad whose bottom edge is shifted by
+    // `slant` (rain streaks, bird wings), drawn at (x + ox, y + oy).
+    void drawQuads(Renderer &r, float w, float h, float slant, Color c, float ox = 0, float oy = 0) const {
+        for (int first = 0; first < n; first += QUADS_PER_BATCH) {
+            int last = min(n, first + QUADS_PER_BATCH);
+            if (!r.quads(last - first)) continue;
+            rlCheckRenderBatchLimit(4 * (last - first));
+            rlSetTexture(rlGetTextureIdDefault());
+            rlBegin(RL_QUADS);
+            rlColor4ub(c.r, c.g, c.b, c.a);
+            rlTexCoord2f(0, 0);
+            for (int i = first; i < last; ++i) {
+                float x = xs[i] + ox, y = ys[i] + oy;
+                rlVertex2f(x, y);
+                rlVertex2f(x + slant, y + h);
+                rlVertex2f(x + slant + w, y + h);
+                rlVertex2f(x + w, y);
+            }
+            rlEnd();
+            rlSetTexture(0);
+        }
+    }
+
+    int size() const { return n; }
+};
+
+// -------------------- City Skyline --------------------
+// The city's buildings in three depth layers. Every building's window grid
+// is a run of bits in one shared arena instead of a vector per row, so a
+// skyline is two flat arrays; regenerating into the same object reuses
+// them. The whole skyline is drawn as one quad batch.
+struct SkylineDepth {
+    int count, width, minHeight, heightRange;
+    int baseCols, rowPitch, margin;
+    float haze;     // blend towards the sky colour
+};
+
+static const SkylineDepth SKYLINE_DEPTHS[] = {
+    {  6, 140, 120, 200, 5, 30, 10, 0.0f },    // nearest: the original street front
+    {  9, 100, 150, 160, 4, 24,  7, 0.35f },
+    { 14,  64, 180, 130, 3, 18,  5, 0.6f },
+};
+static const int NUM_SKYLINE_DEPTHS = sizeof(SKYLINE_DEPTHS) / sizeof(SKYLINE_DEPTHS[0]);
+
+class Skyline {
+public:
+    struct Building {
+        int16_t x, width, height;
+        uint8_t cols, rows;
+        uint8_t depth;          // index into SKYLINE_DEPTHS; 0 is nearest
+        uint32_t firstWindow;   // bit index of window (0,0); row-major
+    };
+
+private:
+    vector<Building> buildings;     // farthest first, so drawing in order layers them
+    vector<uint64_t> windows;
+
+    bool lit(const Building &b, int r, int c) const {
+        uint32_t bit = b.firstWindow + (uint32_t)(r * b.cols + c);
+        return (windows[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    static void quad(float x, float y, float w, float h) {
+        rlVertex2f(x, y);
+        rlVertex2f(x, y + h);
+        rlVertex2f(x + w, y + h);
+        rlVertex2f(x + w, y);
+    }
+
+    static Color hazed(Color c, Color sky, float t) {
+        return (Color){ (unsigned char)(c.r + (sky.r - c.r) * t), (unsigned char)(c.g + (sky.g - c.g) * t),
+                        (unsigned char)(c.b + (sky.b - c.b) * t), c.a };
+    }
+
+public:
+    bool empty() const { return buildings.empty(); }
+    void clear() { buildings.clear(); windows.clear(); }     // keeps the storage
+    int buildingCount() const { return (int)buildings.size(); }
+    size_t windowCount() const { return buildings.empty() ? 0 : buildings.back().firstWindow + (size_t)buildings.back().cols * buildings.back().rows; }
+
+    // Pure function of the seed; safe to run on a worker.
+    void generate(unsigned int seed) {
+        int total = 0;
+        for (int d = 0; d < NUM_SKYLINE_DEPTHS; ++d) total += SKYLINE_DEPTHS[d].count;
+        buildings.clear();
+        buildings.reserve(total);
+        uint32_t bits = 0;
+        for (int d = NUM_SKYLINE_DEPTHS - 1; d >= 0; --d) {
+            const SkylineDepth &L = SKYLINE_DEPTHS[d];
+            unsigned int s = d == 0 ? seed : seed * 2654435761u + d;
+            int spacing = SCREEN_WIDTH / L.count;
+            for (int i = 0; i < L.count; ++i) {
+                Building b;
+                b.x = (int16_t)(i * spacing + (int)(s % 15) - 7 + (i*3));
+                b.width = (int16_t)L.width;
+                b.height = (int16_t)(L.minHeight + ((s + i*37) % L.heightRange));
+                b.cols = (uint8_t)(L.baseCols + ((s + i) % 3));
+                b.rows = (uint8_t)max(4, b.height / L.rowPitch);
+                b.depth = (uint8_t)d;
+                b.firstWindow = bits;
+                bits += (uint32_t)b.cols * b.rows;
+                buildings.push_back(b);
+            }
+        }
+        windows.assign((bits + 63) / 64, 0);
+        for (size_t k = 0; k < buildings.size(); ++k) {
+            const Building &b = buildings[k];
+            // Same per-building sequence as before, counted within its layer
+            int i = (int)k;
+            for (int d = NUM_SKYLINE_DEPTHS - 1; d > b.depth; --d) i -= SKYLINE_DEPTHS[d].count;
+            unsigned int s = b.depth == 0 ? seed : seed * 2654435761u + b.depth;
+            unsigned int s2 = s + i*123;
+            for (int r = 0; r < b.rows; ++r) {
+                for (int c = 0; c < b.cols; ++c) {
+                    unsigned int v = (s2 * (r+3) * (c+7) + 73) % 10;
+                    if (v >= 3) {
+                        uint32_t bit = b.firstWindow + (uint32_t)(r * b.cols + c);
+                        windows[bit >> 6] |= (uint64_t)1 << (bit & 63);
+                    }
+                }
+            }
+        }
+    }
+
+    void swap(Skyline &o) {
+        buildings.swap(o.buildings);
+        windows.swap(o.windows);
+    }
+
+    // Buildings standing on `ground`; farther layers fade towards `sky`. Lit
+    // windows are filled, dark ones outlined with four 1-px quads, all in
+    // the same batch. Only the nearest `depths` layers are drawn.
+    void draw(Renderer &r, int ground, Color sky, int depths = NUM_SKYLINE_DEPTHS) const {
+        if (buildings.empty()) return;
+        int n = 0;
+        for (const Building &b : buildings) {
+            if (b.depth >= depths) continue;
+            n++;
+            for (int y = 0; y < b.rows; ++y)
+                for (int x = 0; x < b.cols; ++x) n += lit(b, y, x) ? 1 : 4;
+        }
+        if (!r.quads(n)) return;
+        const Color body = GRAY, on = Fade(LIGHTGRAY, 0.9f), off = Fade(DARKGRAY, 0.6f);
+        rlSetTexture(rlGetTextureIdDefault());
+        for (const Building &b : buildings) {
+            if (b.depth >= depths) continue;
+            const SkylineDepth &L = SKYLINE_DEPTHS[b.depth];
+            Color cb = hazed(body, sky, L.haze), con = hazed(on, sky, L.haze), coff = hazed(off, sky, L.haze);
+            rlCheckRenderBatchLimit(4 * (1 + 4 * b.cols * b.rows));
+            rlBegin(RL_QUADS);
+            rlTexCoord2f(0, 0);
+            float top = (float)(ground - b.height);
+            rlColor4ub(cb.r, cb.g, cb.b, cb.a);
+            quad(b.x, top, b.width, b.height);
+            float wx = b.x + L.margin, wy = top + L.margin;
+            int cellW = (b.width - 2 * L.margin) / b.cols;
+            int cellH = (b.height - 2 * L.margin) / b.rows;
+            float w = (float)(cellW - 4), h = (float)(cellH - 6);
+            for (int r = 0; r < b.rows; ++r) {
+                for (int c = 0; c < b.cols; ++c) {
+                    float x = wx + c * cellW + 2, y = wy + r * cellH + 2;
+                    if (lit(b, r, c)) {
+                        rlColor4ub(con.r, con.g, con.b, con.a);
+                        quad(x, y, w, h);
+                    } else {
+                        rlColor4ub(coff.r, coff.g, coff.b, coff.a);
+                        quad(x, y, w, 1);
+                        quad(x, y + h - 1, w, 1);
+                        quad(x, y + 1, 1, h - 2);
+                        quad(x + w - 1, y + 1, 1, h - 2);
+                    }
+                }
+            }
+            rlEnd();
+        }
+        rlSetTexture(0);
+    }
+};
+
+// -------------------- SceneManager --------------------
+// What SceneManager::drawBackground() needs, by value, so a recorded frame
+// can be drawn while the simulation moves on to the next scene state.
+struct SceneFrame {
+    bool cached;            // the static layer is baked and current
+    SceneType scene;
+    int timer;
+    RenderTexture2D layer, nextLayer;
+    float crossfade;        // 0 when there is no prefetched layer to fade in
+};
+
+class SceneManager {
+    SceneType currentScene;
+    int sceneTimer;
+    float transitionAlpha;
+    bool transitioning;
+    // Kept across scenes: a run starting in the city reuses the last one
+    Skyline skyline;
+    Future<shared_ptr<Skyline>> firstSkyline;
+
+    // Static part of the current scene, baked once per scene (or city rebuild)
+    RenderTexture2D layer;
+    SceneType layerScene;
+    bool layerDirty;
+    bool layerFailed;
+
+    // Ambient particles; rain, snow and stars scale with the density and
+    // the governor's detail fraction
+    WeatherBatch weather;
+    int weatherDensity;
+    float weatherDetail;
+    int skylineDepths;
+
+    // The next scene, prepared ahead of its transition: generated content
+    // comes from a worker, its layer is baked during the run-up, and the two
+    // layers crossfade over the ramp so the switch itself is just a swap
+    JobQueue *prefetchPool;
+    FrameDispatcher *prefetchDispatcher;
+    uint32_t prefetchGen;       // bumped on reset and switch; stale results are dropped
+    bool prefetchRequested;
+    bool nextContentReady;
+    Skyline nextSkyline;
+    shared_ptr<Skyline> spareSkyline;   // worker output buffer, recycled
+    RenderTexture2D nextLayer;
+    bool nextLayerReady;
+    bool nextLayerFailed;       // no texture for it: switches re-bake `layer` instead
+
+public:
+    static const int SCENE_FRAMES = 1200;   // frames before a transition starts
+    static const int PREFETCH_LEAD = 60;    // frames before that to start preparing the next scene
+    static const int TRANSITION_FRAMES = 50;
+
+    SceneManager()
+        : currentScene(CITY), sceneTimer(0), transitionAlpha(0),
+          transitioning(false),
+          layer(), layerScene(CITY), layerDirty(true), layerFailed(false), weatherDensity(1), weatherDetail(1.0f), skylineDepths(NUM_SKYLINE_DEPTHS),
+          prefetchPool(nullptr), prefetchDispatcher(nullptr), prefetchGen(0), prefetchRequested(false),
+          nextContentReady(false), nextLayer(), nextLayerReady(false), nextLayerFailed(false) {}
+
+    // Without this, the next scene's content is generated on the main thread.
+    // The first skyline starts generating right away.
+    void enablePrefetch(JobQueue &jobs, FrameDispatcher &dispatcher) {
+        prefetchPool = &jobs;
+        prefetchDispatcher = &dispatcher;
+        if (skyline.empty() && !firstSkyline.valid()) {
+            unsigned int seed = (unsigned int)time(NULL);
+            firstSkyline = jobs.submit([seed]() {
+                shared_ptr<Skyline> s = make_shared<Skyline>();
+                s->generate(seed);
+                return s;
+            });
+        }
+    }
+
+    // Back to the first scene.
+    void reset() {
+        currentScene = CITY;
+        sceneTimer = 0;
+        transitionAlpha = 0;
+        transitioning = false;
+        layerDirty = true;
+        dropPrefetch();
+    }
+
+    SceneType getCurrentScene() const { return currentScene; }
+
+    SceneType nextScene() const { return (SceneType)(((int)currentScene + 1) % NUM_SCENES); }
+
+    void update() {
+        sceneTimer++;
+        if (sceneTimer > SCENE_FRAMES - PREFETCH_LEAD && !prefetchRequested) requestNextScene();
+        if (sceneTimer > SCENE_FRAMES) {
+            if (!transitioning) { transitioning = true; transitionAlpha = 0; }
+        }
+        if (transitioning) {
+            transitionAlpha += 1.0f / TRANSITION_FRAMES;
+            if (transitionAlpha >= 1.0f) switchToNext();
+        }
+    }
+
+    Color getRoadColor() const { return roadColorOf(currentScene); }
+    Color getSkyColor() const { return skyColorOf(currentScene); }
+    Color getLineColor() const { return lineColorOf(currentScene); }
+
+    static Color roadColorOf(SceneType s) {
+        switch(s) {
+            case CITY: return DARKGRAY;
+            case HIGHWAY: return (Color){50,50,50,255};
+            case DESERT: return (Color){139,90,43,255};
+            case NIGHT: return (Color){30,30,40,255};
+            case FOREST: return (Color){60,70,50,255};
+            case SNOW: return (Color){200,200,220,255};
+            case SUNSET: return (Color){80,60,50,255};
+            case RAIN: return (Color){40,40,45,255};
+            default: return DARKGRAY;
+        }
+    }
+
+    static Color skyColorOf(SceneType s) {
+        switch(s) {
+            case CITY: return SKYBLUE;
+            case HIGHWAY: return (Color){135,206,235,255};
+            case DESERT: return (Color){255,200,124,255};
+            case NIGHT: return (Color){25,25,50,255};
+            case FOREST: return (Color){100,180,100,255};
+            case SNOW: return (Color){220,230,240,255};
+            case SUNSET: return (Color){255,140,90,255};
+            case RAIN: return (Color){80,90,100,255};
+            default: return SKYBLUE;
+        }
+    }
+
+    static Color lineColorOf(SceneType s) {
+        switch(s) {
+            case CITY: return YELLOW;
+            case HIGHWAY: return WHITE;
+            case DESERT: return (Color){255,255,150,255};
+            case NIGHT: return (Color){255,255,100,255};
+            case FOREST: return (Color){255,255,200,255};
+            case SNOW: return (Color){255,200,0,255};
+            case SUNSET: return (Color){255,220,150,255};
+            case RAIN: return (Color){200,200,255,255};
+            default: return YELLOW;
+        }
+    }
+
+    const char* getSceneName() const { return sceneName(currentScene); }
+    static const char* sceneName(SceneType s) {
+        switch(s) {
+            case CITY: return "CITY";
+            case HIGHWAY: return "HIGHWAY";
+            case DESERT: return "DESERT";
+            case NIGHT: return "NIGHT";
+            case FOREST: return "FOREST";
+            case SNOW: return "SNOW";
+            case SUNSET: return "SUNSET";
+            case RAIN: return "RAIN";
+            default: return "UNKNOWN";
+        }
+    }
+
+    // The skyline the city needs before its first bake: the startup job's
+    // result, or generated here when there is no pool.
+    void ensureSkyline() {
+        if (!skyline.empty()) return;
+        if (firstSkyline.valid()) {
+            skyline.swap(*firstSkyline.get());
+            firstSkyline = Future<shared_ptr<Skyline>>();
+        } else {
+            skyline.generate((unsigned int)time(NULL) ^ (unsigned int)sceneTimer);
+        }
+        layerDirty = true;
+    }
+
+    // Bakes the current scene's static layer if it is stale; true if it
+    // did. Call outside BeginDrawing/EndDrawing: ending texture mode resets
+    // the 2D camera.
+    bool prepareBackground(Renderer &r) {
+        if (getCurrentScene() == CITY) ensureSkyline();
+        if (!layerFailed && !nextLayerFailed && nextContentReady && !nextLayerReady) bakeNext(r);
+        if (layerFailed || (layerScene == currentScene && !layerDirty)) return false;
+        if (layer.id == 0) {
+            layer = r.loadTarget(SCREEN_WIDTH, SCREEN_HEIGHT, false);
+            if (layer.id == 0) {
+                TraceLog(LOG_WARNING, "SCENE: No render texture for the static layer; drawing it every frame");
+                layerFailed = true;
+                return false;
+            }
+        }
+        auto t0 = chrono::steady_clock::now();
+        r.beginTarget(layer, RAYWHITE, false);
+        drawStaticLayer(r, currentScene, skyline);
+        r.endTarget();
+        layerScene = currentScene;
+        layerDirty = false;
+        TraceLog(LOG_INFO, "SCENE: Baked %s background in %.2f ms",
+                 getSceneName(), chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+        return true;
+    }
+
+    void unloadLayer(Renderer &r) {
+        if (layer.id != 0) r.unloadTarget(layer);
+        if (nextLayer.id != 0) r.unloadTarget(nextLayer);
+        layer = nextLayer = RenderTexture2D();
+        layerDirty = true;
+        nextLayerReady = false;
+    }
+
+    // False once a render texture for the layer could not be created.
+    bool canCacheLayer() const { return !layerFailed; }
+
+    void setWeatherDensity(int d) {
+        d = max(1, min(d, MAX_WEATHER_DENSITY));
+        if (d != weatherDensity) { weatherDensity = d; layerDirty = true; }
+    }
+
+    // Quality knobs; both re-bake the layers that show them.
+    void setWeatherDetail(float f) {
+        if (f != weatherDetail) { weatherDetail = f; invalidateLayers(); }
+    }
+
+    void setSkylineDepths(int d) {
+        d = max(1, min(d, NUM_SKYLINE_DEPTHS));
+        if (d != skylineDepths) { skylineDepths = d; invalidateLayers(); }
+    }
+
+    void drawBackground(Renderer &r) { drawBackground(frame(), r); }
+
+    using Frame = SceneFrame;
+
+    Frame frame() const {
+        Frame f;
+        f.cached = layer.id != 0 && layerScene == currentScene && !layerDirty;
+        f.scene = currentScene;
+        f.timer = sceneTimer;
+        f.layer = layer;
+        f.nextLayer = nextLayer;
+        f.crossfade = transitioning && nextLayerReady ? min(transitionAlpha, 1.0f) : 0.0f;
+        return f;
+    }
+
+    void drawBackground(const Frame &f, Renderer &r) {
+        if (f.cached) {
+            r.texture(f.layer, 0, 0, WHITE, false);
+            drawAnimatedLayer(r, f.scene, f.timer, 1.0f);
+        } else {
+            if (getCurrentScene() == CITY) ensureSkyline();
+            drawStaticLayer(r, currentScene, skyline);
+            drawAnimatedLayer(r, currentScene, sceneTimer, 1.0f);
+        }
+        // Crossfade towards the prefetched scene over the transition ramp
+        if (f.crossfade > 0) {
+            r.texture(f.nextLayer, 0, 0, Fade(WHITE, f.crossfade), false);
+            drawAnimatedLayer(r, (SceneType)(((int)f.scene + 1) % NUM_SCENES), 0, f.crossfade);
+        }
+    }
+
+private:
+    void requestNextScene() {
+        prefetchRequested = true;
+        // Only the city has generated content; without a pool it is made at bake time
+        if (nextScene() != CITY || !prefetchPool) { nextContentReady = true; return; }
+        uint32_t gen = prefetchGen;
+        unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)sceneTimer;
+        // The worker fills a buffer nothing else touches until it comes back;
+        // its contents are swapped in, so the arrays are reused between cities
+        shared_ptr<Skyline> buf = spareSkyline ? spareSkyline : make_shared<Skyline>();
+        spareSkyline.reset();
+        prefetchPool->submit([buf, seed]() { buf->generate(seed); return buf; })
+            .then(*prefetchDispatcher, [this, gen](const shared_ptr<Skyline> &b) {
+                if (gen == prefetchGen) {
+                    nextSkyline.swap(*b);
+                    nextContentReady = true;
+                }
+                spareSkyline = b;
+            });
+    }
+
+    // Main thread, outside BeginDrawing, some frames before the switch.
+    void bakeNext(Renderer &r) {
+        auto t0 = chrono::steady_clock::now();
+        SceneType next = nextScene();
+        if (next == CITY && nextSkyline.empty()) nextSkyline.generate((unsigned int)time(NULL) ^ prefetchGen);
+        if (nextLayer.id == 0) {
+            nextLayer = r.loadTarget(SCREEN_WIDTH, SCREEN_HEIGHT, false);
+            if (nextLayer.id == 0) {
+                TraceLog(LOG_WARNING, "SCENE: No render texture for the prefetched layer; scene switches re-bake without a crossfade");
+                nextLayerFailed = true;
+                return;
+            }
+        }
+        r.beginTarget(nextLayer, RAYWHITE, false);
+        drawStaticLayer(r, next, nextSkyline);
+        r.endTarget();
+        nextLayerReady = true;
+        TraceLog(LOG_INFO, "SCENE: Prefetched %s; layer baked in %.2f ms, %d frames before the switch",
+                 sceneName(next), chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count(),
+                 SCENE_FRAMES + TRANSITION_FRAMES - sceneTimer);
+    }
+
+    // End of the ramp: the prefetched layer and content become current.
+    void switchToNext() {
+        currentScene = nextScene();
+        sceneTimer = 0;
+        transitioning = false;
+        transitionAlpha = 0;
+        if (nextLayerReady) {
+            swap(layer, nextLayer);
+            layerScene = currentScene;
+            layerDirty = false;
+        } else {
+            layerDirty = true;
+        }
+        if (currentScene == CITY && !nextSkyline.empty()) skyline.swap(nextSkyline);
+        dropPrefetch();
+    }
+
+    void dropPrefetch() {
+        prefetchGen++;
+        prefetchRequested = nextContentReady = nextLayerReady = false;
+        nextSkyline.clear();
+    }
+
+    int weatherCount(int base) const { return max(1, (int)(base * weatherDensity * weatherDetail)); }
+
+    // The prefetched layer is re-baked too if it is already done.
+    void invalidateLayers() {
+        layerDirty = true;
+        nextLayerReady = false;
+    }
+
+    // Everything that only changes with the scene (or the city's skyline).
+    void drawStaticLayer(Renderer &r, SceneType scene, const Skyline &skyline) {
+        Color sky = skyColorOf(scene);
+        
+        // Draw gradient sky background
+        for (int i = 0; i < SCREEN_HEIGHT/2; ++i) {
+            float a = (float)i / (SCREEN_HEIGHT/2);
+            Color grad = ColorAlpha(sky, 1.0f - a*0.3f);
+            r.rectangle(0, i, SCREEN_WIDTH, 1, grad);
+        }
+
+        r.rectangle(0, (int)(SCREEN_HEIGHT * 0.5f), SCREEN_WIDTH, (int)(SCREEN_HEIGHT * 0.5f), Fade(roadColorOf(scene), 0.5f));
+
+        // Scene-specific elements
+        if (scene == CITY) {
+            skyline.draw(r, (int)(SCREEN_HEIGHT * 0.5f), sky, skylineDepths);
+        } else if (scene == DESERT) {
+            // Sun
+            r.circle(SCREEN_WIDTH - 100, 100, 50, ORANGE);
+            r.circle(SCREEN_WIDTH - 100, 100, 60, Fade(ORANGE, 0.25f));
+            // Sand dunes
+            for (int i = 0; i < 5; i++) {
+                r.circle(i * 250 + 100, (int)(SCREEN_HEIGHT * 0.5f) - 20, 80, Fade((Color){210, 180, 140, 255}, 0.6f));
+            }
+            // Cacti
+            r.rectangle(150, (int)(SCREEN_HEIGHT * 0.5f) - 80, 20, 80, (Color){34, 139, 34, 255});
+            r.rectangle(135, (int)(SCREEN_HEIGHT * 0.5f) - 50, 30, 15, (Color){34, 139, 34, 255});
+            r.rectangle(700, (int)(SCREEN_HEIGHT * 0.5f) - 70, 18, 70, (Color){34, 139, 34, 255});
+        } else if (scene == NIGHT) {
+            // Moon
+            r.circle(100, 80, 30, Fade(WHITE, 0.8f));
+            r.circle(110, 75, 28, Fade((Color){25, 25, 50, 255}, 1.0f));
+            // Stars
+            weather.layout(weatherCount(30), WeatherPattern{123, 456, 0, 0}, 0, SCREEN_WIDTH, 300);
+            weather.drawQuads(r, 4, 4, 0, WHITE, -2, -2);
+        } else if (scene == FOREST) {
+            // Trees in background
+            for (int i = 0; i < 8; i++) {
+                int x = i * 130 + 50;
+                int h = 100 + (i * 17) % 50;
+                r.triangle(
+                    (Vector2){(float)x, (float)(SCREEN_HEIGHT * 0.5f) - h},
+                    (Vector2){(float)(x - 40), (float)(SCREEN_HEIGHT * 0.5f)},
+                    (Vector2){(float)(x + 40), (float)(SCREEN_HEIGHT * 0.5f)},
+                    (Color){34, 139, 34, 200}
+                );
+                r.rectangle(x - 10, (int)(SCREEN_HEIGHT * 0.5f) - h/3, 20, h/3, (Color){101, 67, 33, 255});
+            }
+        } else if (scene == SNOW) {
+            // Mountains
+            r.triangle(
+                (Vector2){200, (float)(SCREEN_HEIGHT * 0.5f)},
+                (Vector2){100, (float)(SCREEN_HEIGHT * 0.5f)},
+                (Vector2){150, (float)(SCREEN_HEIGHT * 0.5f) - 120},
+                (Color){200, 200, 220, 255}
+            );
+            r.triangle(
+                (Vector2){400, (float)(SCREEN_HEIGHT * 0.5f)},
+                (Vector2){250, (float)(SCREEN_HEIGHT * 0.5f)},
+                (Vector2){325, (float)(SCREEN_HEIGHT * 0.5f) - 150},
+                (Color){220, 220, 240, 255}
+            );
+            r.triangle(
+                (Vector2){900, (float)(SCREEN_HEIGHT * 0.5f)},
+                (Vector2){700, (float)(SCREEN_HEIGHT * 0.5f)},
+                (Vector2){800, (float)(SCREEN_HEIGHT * 0.5f) - 130},
+                (Color){210, 210, 230, 255}
+            );
+        } else if (scene == SUNSET) {
+            // Large sun on horizon
+            r.circle((int)(SCREEN_WIDTH * 0.5f), (int)(SCREEN_HEIGHT * 0.5f) - 50, 80, (Color){255, 140, 0, 200});
+            r.circle((int)(SCREEN_WIDTH * 0.5f), (int)(SCREEN_HEIGHT * 0.5f) - 50, 100, Fade((Color){255, 100, 0, 255}, 0.3f));
+            // Clouds
+            for (int i = 0; i < 4; i++) {
+                int x = i * 250 + 50;
+                int y = 100 + (i * 30) % 80;
+                r.circle(x, y, 30, Fade((Color){255, 180, 120, 255}, 0.6f));
+                r.circle(x + 30, y, 25, Fade((Color){255, 180, 120, 255}, 0.5f));
+                r.circle(x - 20, y + 10, 20, Fade((Color){255, 180, 120, 255}, 0.4f));
+            }
+        }
+    }
+
+    // Elements that move with the scene timer, drawn every frame over the
+    // layer; `alpha` fades them in during a crossfade.
+    void drawAnimatedLayer(Renderer &r, SceneType scene, int timer, float alpha) {
+        if (scene == FOREST) {
+            // Birds: a "^" of two slanted strokes
+            weather.layout(5, WeatherPattern{200, 30, 1, 0}, timer, SCREEN_WIDTH, 100);
+            weather.drawQuads(r, 2, 6, -4, Fade(BLACK, 0.3f * alpha), 4, 52);
+            weather.drawQuads(r, 2, 6, 4, Fade(BLACK, 0.3f * alpha), 4, 52);
+        } else if (scene == SNOW) {
+            // Falling snow
+            weather.layout(weatherCount(50), WeatherPattern{77, 93, 1, 2}, timer, SCREEN_WIDTH, SCREEN_HEIGHT);
+            weather.drawQuads(r, 4, 4, 0, Fade(WHITE, alpha), -2, -2);
+        } else if (scene == RAIN) {
+            // Dark clouds
+            for (int i = 0; i < 6; i++) {
+                int x = i * 180 + (timer/2) % 180;
+                int y = 50 + (i * 20) % 60;
+                r.circle(x, y, 40, Fade((Color){60, 70, 80, 255}, 0.7f * alpha));
+                r.circle(x + 30, y, 35, Fade((Color){60, 70, 80, 255}, 0.6f * alpha));
+            }
+            // Rain drops
+            weather.layout(weatherCount(100), WeatherPattern{53, 71, 0, 8}, timer, SCREEN_WIDTH, SCREEN_HEIGHT);
+            weather.drawQuads(r, 1, 10, 2, Fade((Color){150, 180, 200, 255}, 0.5f * alpha));
+        }
+    }
+};
+
+// -------------------- Car --------------------
+// Enemy paint colours; each has a sprite in the car atlas, the player's last.
+static const Color CAR_COLORS[] = {RED, BLUE, GREEN, ORANGE, PURPLE, PINK, MAROON};
+const int NUM_CAR_COLORS = 7;
+const int CAR_SPRITE_PLAYER = NUM_CAR_COLORS;
+const int NUM_CAR_SPRITES = NUM_CAR_COLORS + 1;
+static const Color PLAYER_CAR_COLOR = GREEN;
+
+class Car {
+private:
+    Position pos;
+    Position target;
+    float speed;
+    int lane;
+    Color color;
+    bool isPlayer;
+    float smooth;
+    int spriteIdx;   // cell in the car atlas, -1 if this colour has none
+public:
+    Car(float x, float y, int laneIdx, float spd, Color c, bool player=false)
+        : pos(x,y), target(x,y), speed(spd), lane(laneIdx), color(c), isPlayer(player), smooth(0.15f), spriteIdx(-1) {
+        if (player) spriteIdx = ColorToInt(c) == ColorToInt(PLAYER_CAR_COLOR) ? CAR_SPRITE_PLAYER : -1;
+        else for (int i = 0; i < NUM_CAR_COLORS; ++i) if (ColorToInt(c) == ColorToInt(CAR_COLORS[i])) spriteIdx = i;
+    }
+    void update(float speedMultiplier = 1.0f) {
+        if (!isPlayer) pos.y += speed * speedMultiplier;
+        else { pos.x += (target.x - pos.x) * smooth; pos.y += (target.y - pos.y) * smooth; }
+    }
+    void draw(Renderer &r) const {
+        r.ellipse(pos.x, pos.y + 45, 30, 10, Fade(BLACK, 0.3f));
+        r.rectangle(pos.x - 30, pos.y - 50, 60, 100, color);
+        r.rectangleGradientV(pos.x - 30, pos.y - 50, 60, 40, Fade(WHITE,0.2f), Fade(BLACK,0.0f));
+        if (isPlayer) {
+            r.rectangle(pos.x - 30, pos.y - 60, 60, 20, Fade(color, 0.8f));
+            r.triangle((Vector2){pos.x, pos.y - 60}, (Vector2){pos.x - 30, pos.y - 40}, (Vector2){pos.x + 30, pos.y - 40}, RED);
+            r.rectangle(pos.x - 5, pos.y - 50, 10, 100, Fade(WHITE,0.7f));
+        }
+        Color wc = {100,150,200,200};
+        r.rectangle(pos.x-22, pos.y-30, 44, 25, wc);
+        r.rectangle(pos.x-22, pos.y-30, 44, 5, Fade(WHITE, 0.5f));
+        Rectangle w1 = {pos.x - 35, pos.y - 35, 12, 20};
+        Rectangle w2 = {pos.x + 23, pos.y - 35, 12, 20};
+        Rectangle w3 = {pos.x - 35, pos.y + 15, 12, 20};
+        Rectangle w4 = {pos.x + 23, pos.y + 15, 12, 20};
+        r.rectangleRounded(w1, 0.3f, 6, DARKGRAY);
+        r.rectangleRounded(w2, 0.3f, 6, DARKGRAY);
+        r.rectangleRounded(w3, 0.3f, 6, DARKGRAY);
+        r.rectangleRounded(w4, 0.3f, 6, DARKGRAY);
+        if (isPlayer) {
+            r.rectangle(pos.x - 25, pos.y + 45, 18, 6, YELLOW);
+            r.rectangle(pos.x + 7, pos.y + 45, 18, 6, YELLOW);
+            r.circle(pos.x - 16, pos.y + 48, 4, Fade(YELLOW,0.6f));
+            r.circle(pos.x + 16, pos.y + 48, 4, Fade(YELLOW,0.6f));
+        } else {
+            r.rectangle(pos.x - 25, pos.y - 48, 18, 6, RED);
+            r.rectangle(pos.x + 7, pos.y - 48, 18, 6, RED);
+        }
+    }
+    CollisionBox box() const { return { pos.x - 30, pos.y - 50, 60, 100 }; }
+    Position getPos() const { return pos; }
+    int sprite() const { return spriteIdx; }
+    int getLane() const { return lane; }
+    void setLane(int l) { lane = l; }
+    void setPos(float x, float y) { pos.x = x; pos.y = y; }
+    void setTarget(float x, float y) { target.x = x; target.y = y; }
+    void setSpeed(float s) { speed = s; }
+};
+
+// -------------------- Car Sprite Atlas --------------------
+// Each car variant (the enemy colours plus the player) is drawn once into
+// one texture at startup. Cars are then textured quads from it, submitted
+// as one batch per call instead of each car's primitives.
+class CarAtlas {
+    RenderTexture2D target;
+
+    static const int QUADS_PER_BATCH = 2048;
+
+public:
+    static const int CELL_W = 80, CELL_H = 128;
+    static const int ORIGIN_X = 40, ORIGIN_Y = 66;  // car position inside its cell
+
+    CarAtlas(): target() {}
+    bool ready() const { return target.id != 0; }
+
+    // The cells are stored premultiplied so translucent shadows and
+    // highlights composite exactly as when drawn directly.
+    void bake(Renderer &r) {
+        if (ready()) return;
+        target = r.loadTarget(CELL_W * NUM_CAR_SPRITES, CELL_H, false);
+        if (target.id == 0) {
+            TraceLog(LOG_WARNING, "CARS: No render texture for the sprite atlas; drawing cars as primitives");
+            return;
+        }
+        r.beginTarget(target, BLANK, true);
+        for (int i = 0; i < NUM_CAR_SPRITES; ++i) {
+            bool player = i == CAR_SPRITE_PLAYER;
+            Car c((float)(i * CELL_W + ORIGIN_X), (float)ORIGIN_Y, 0, 0.0f, player ? PLAYER_CAR_COLOR : CAR_COLORS[i], player);
+            c.draw(r);
+        }
+        r.endTarget();
+        TraceLog(LOG_INFO, "CARS: Baked %d car sprites (%dx%d atlas)", NUM_CAR_SPRITES, CELL_W * NUM_CAR_SPRITES, CELL_H);
+    }
+
+    void unload(Renderer &r) {
+        if (ready()) r.unloadTarget(target);
+        target = RenderTexture2D();
+    }
+
+    // Cars whose colour has no cell are drawn as primitives after the batch.
+    void draw(Renderer &r, const Car *cars, size_t n) const {
+        if (!ready()) {
+            for (size_t i = 0; i < n; ++i) cars[i].draw(r);
+            return;
+        }
+        float du = 1.0f / NUM_CAR_SPRITES;
+        bool unsprited = false;
+        for (size_t first = 0; first < n; first += QUADS_PER_BATCH) {
+            size_t last = min(n, first + QUADS_PER_BATCH);
+            int quads = 0;
+            for (size_t i = first; i < last; ++i) quads += cars[i].sprite() >= 0;
+            if (quads < (int)(last - first)) unsprited = true;
+            if (quads == 0 || !r.quads(quads)) continue;
+            BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+            rlCheckRenderBatchLimit(4 * quads);
+            rlSetTexture(target.texture.id);
+            rlBegin(RL_QUADS);
+            rlColor4ub(255, 255, 255, 255);
+            for (size_t i = first; i < last; ++i) {
+                if (cars[i].sprite() < 0) continue;
+                // Snap like the primitives do, so sprites stay pixel-exact
+                float x = floorf(cars[i].getPos().x) - ORIGIN_X, y = floorf(cars[i].getPos().y) - ORIGIN_Y;
+                float u0 = cars[i].sprite() * du, u1 = u0 + du;
+                // Render textures are stored bottom-up
+                rlTexCoord2f(u0, 1); rlVertex2f(x, y);
+                rlTexCoord2f(u0, 0); rlVertex2f(x, y + CELL_H);
+                rlTexCoord2f(u1, 0); rlVertex2f(x + CELL_W, y + CELL_H);
+                rlTexCoord2f(u1, 1); rlVertex2f(x + CELL_W, y);
+            }
+            rlEnd();
+            rlSetTexture(0);
+            EndBlendMode();
+        }
+        if (unsprited) for (size_t i = 0; i < n; ++i) if (cars[i].sprite() < 0) cars[i].draw(r);
+    }
+};
+
+// -------------------- Particle System --------------------
+// Fixed-capacity pool in structure-of-arrays form: one pass integrates four
+// particles at a time (SSE2) and compacts the survivors in place, and the
+// whole pool is drawn as one batch of textured quads. Emitters describe
+// each effect's burst; when the pool is full, new particles are dropped.
+enum ParticleEffect { EFFECT_SHIELD_HIT, EFFECT_CRASH, EFFECT_PICKUP, NUM_PARTICLE_EFFECTS };
+
+struct ParticleEmitter {
+    int count;
+    Color color;
+    float speedMin, speedRange;   // pixels per frame, random direction
+    float sizeMin, sizeRange;     // radius in pixels
+};
+
+static const ParticleEmitter PARTICLE_EMITTERS[NUM_PARTICLE_EFFECTS] = {
+    { 30, SKYBLUE, 1.5f, 100 / 60.0f, 2.0f, 1.0f },   // shield absorbs a hit
+    { 40, RED,     1.5f, 100 / 60.0f, 2.0f, 1.0f },   // player loses a life
+    { 28, GOLD,    1.5f, 100 / 60.0f, 2.0f, 1.0f },   // power-up collected
+};
+
+class ParticleSystem {
+public:
+    static const int CAPACITY = 4096;
+
+private:
+    static const int SPRITE_SIZE = 16;
+    static constexpr float GRAVITY = 0.15f;
+    static constexpr float FADE = 0.02f;     // life and radius lost per frame
+
+    // Padded to a multiple of four so the SIMD loop never needs a tail
+    alignas(16) float px[CAPACITY], py[CAPACITY], vx[CAPACITY], vy[CAPACITY], life[CAPACITY], size[CAPACITY];
+    Color col[CAPACITY];
+    int n;
+    int limit;          // quality cap, at most CAPACITY
+    uint64_t dropped;
+    Texture2D sprite;   // soft white disc, created on first draw
+
+    void copy(int to, int from) {
+        px[to] = px[from]; py[to] = py[from]; vx[to] = vx[from]; vy[to] = vy[from];
+        life[to] = life[from]; size[to] = size[from]; col[to] = col[from];
+    }
+
+public:
+    ParticleSystem(): n(0), limit(CAPACITY), dropped(0), sprite() {}
+
+    int count() const { return n; }
+    uint64_t droppedCount() const { return dropped; }
+    void clear() { n = 0; }
+    // Live particles already above a lowered cap fade out on their own.
+    void setLimit(int cap) { limit = cap < 0 ? 0 : cap > CAPACITY ? (int)CAPACITY : cap; }
+
+    void emit(ParticleEffect effect, float x, float y) {
+        const ParticleEmitter &e = PARTICLE_EMITTERS[effect];
+        for (int i = 0; i < e.count; ++i) {
+            if (n >= limit) { dropped += e.count - i; return; }
+            float ang = (rand()%360) * DEG2RAD;
+            float sp = e.speedMin + (rand()%100) / 100.0f * e.speedRange;
+            px[n] = x; py[n] = y;
+            vx[n] = cos(ang)*sp; vy[n] = sin(ang)*sp;
+            col[n] = e.color; life[n] = 1.0f;
+            size[n] = e.sizeMin + (rand()%50) / 50.0f * e.sizeRange;
+            n++;
+        }
+    }
+
+    // One frame: integrate, then move survivors down over the dead ones.
+    void update() {
+        int padded = (n + 3) & ~3;
+        for (int i = n; i < padded; ++i) { life[i] = 0; size[i] = 0; px[i] = py[i] = vx[i] = vy[i] = 0; }
+        int keep = 0;
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128 g = _mm_set1_ps(GRAVITY), fade = _mm_set1_ps(FADE), zero = _mm_setzero_ps();
+        for (; i < padded; i += 4) {
+            __m128 x = _mm_load_ps(px + i), y = _mm_load_ps(py + i);
+            __m128 u = _mm_load_ps(vx + i), v = _mm_load_ps(vy + i);
+            __m128 l = _mm_sub_ps(_mm_load_ps(life + i), fade), s = _mm_sub_ps(_mm_load_ps(size + i), fade);
+            _mm_store_ps(px + i, _mm_add_ps(x, u));
+            _mm_store_ps(py + i, _mm_add_ps(y, v));
+            _mm_store_ps(vy + i, _mm_add_ps(v, g));
+            _mm_store_ps(life + i, l);
+            _mm_store_ps(size + i, s);
+            int alive = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(l, zero), _mm_cmpgt_ps(s, zero)));
+            if (alive == 0xF && keep == i) { keep += 4; continue; }   // nothing to move yet
+            for (int k = 0; k < 4; ++k) {
+                if (!(alive >> k & 1)) continue;
+                if (keep != i + k) copy(keep, i + k);
+                keep++;
+            }
+        }
+#else
+        for (; i < padded; ++i) {
+            px[i] += vx[i]; py[i] += vy[i]; vy[i] += GRAVITY;
+            life[i] -= FADE; size[i] -= FADE;
+            if (life[i] > 0 && size[i] > 0) {
+                if (keep != i) copy(keep, i);
+                keep++;
+            }
+        }
+#endif
+        n = keep;
+    }
+
+    // Copies the live particles into a recorded frame; alpha follows the
+    // remaining life, as before.
+    void snapshot(vector<float> &x, vector<float> &y, vector<float> &r, vector<Color> &c) const {
+        for (int i = 0; i < n; ++i) {
+            x.push_back(px[i]);
+            y.push_back(py[i]);
+            r.push_back(size[i]);
+            c.push_back((Color){col[i].r, col[i].g, col[i].b, (unsigned char)(col[i].a * min(life[i], 1.0f))});
+        }
+    }
+
+    // Draws a snapshot as one batch of quads.
+    void drawBatch(Renderer &out, const float *x, const float *y, const float *r, const Color *c, int count) {
+        if (count == 0 || !out.quads(count)) return;
+        if (sprite.id == 0) {
+            Image img = GenImageColor(SPRITE_SIZE, SPRITE_SIZE, BLANK);
+            ImageDrawCircle(&img, SPRITE_SIZE / 2, SPRITE_SIZE / 2, SPRITE_SIZE / 2, WHITE);
+            sprite = LoadTextureFromImage(img);
+            UnloadImage(img);
+            SetTextureFilter(sprite, TEXTURE_FILTER_BILINEAR);
+        }
+        rlCheckRenderBatchLimit(4 * count);
+        rlSetTexture(sprite.id);
+        rlBegin(RL_QUADS);
+        for (int i = 0; i < count; ++i) {
+            rlColor4ub(c[i].r, c[i].g, c[i].b, c[i].a);
+            rlTexCoord2f(0, 0); rlVertex2f(x[i] - r[i], y[i] - r[i]);
+            rlTexCoord2f(0, 1); rlVertex2f(x[i] - r[i], y[i] + r[i]);
+            rlTexCoord2f(1, 1); rlVertex2f(x[i] + r[i], y[i] + r[i]);
+            rlTexCoord2f(1, 0); rlVertex2f(x[i] + r[i], y[i] - r[i]);
+        }
+        rlEnd();
+        rlSetTexture(0);
+    }
+
+    void unload() {
+        if (sprite.id != 0) UnloadTexture(sprite);
+        sprite = Texture2D();
+    }
+};
+
+// -------------------- Road Renderer --------------------
+// The road is two textured quads: a base layer (surface gradient, shoulders
+// and edge lines) and a tile of lane markings and surface detail that
+// repeats down the road and scrolls by offsetting its texture coordinates.
+// Both are re-baked only when the scene's road or line colour changes.
+class RoadRenderer {
+public:
+    static constexpr float DASH_H = 30.0f, GAP_H = 22.0f;
+    static constexpr float PATTERN = DASH_H + GAP_H;
+    static constexpr float PERIOD = PATTERN * 4;   // tile height; the offset wraps at this
+    static const int SHOULDER = 20;
+
+private:
+    RenderTexture2D base, tile;
+    int bakedRoad, bakedLine;
+    bool failed;
+
+    // Static across the screen: body gradient, shoulders, edge lines.
+    // (x0, y0) is the top-left of the shoulder-to-shoulder strip.
+    static void drawBase(Renderer &r, int x0, int y0, Color road) {
+        int x = x0 + SHOULDER;
+        r.rectangleGradientV(x, y0, ROAD_WIDTH, SCREEN_HEIGHT, road, Fade(road, 0.7f));
+        r.rectangleGradientH(x - SHOULDER, y0, SHOULDER, SCREEN_HEIGHT, BLACK, road);
+        r.rectangleGradientH(x + ROAD_WIDTH, y0, SHOULDER, SCREEN_HEIGHT, road, BLACK);
+        r.rectangle(x - 5, y0, 5, SCREEN_HEIGHT, WHITE);
+        r.rectangle(x + ROAD_WIDTH, y0, 5, SCREEN_HEIGHT, WHITE);
+    }
+    // One PERIOD of markings with its top-left at (x0, y0).
+    static void drawTile(Renderer &r, int x0, int y0, Color line) {
+        for (int lane = 1; lane < NUM_LANES; ++lane) {
+            int x = x0 + lane * LANE_WIDTH;
+            for (float y = 0; y < PERIOD; y += PATTERN) {
+                int yPos = y0 + (int)y;
+                r.rectangle(x - 4, yPos, 8, (int)DASH_H, line);
+                r.rectangle(x - 3, yPos + 1, 6, (int)DASH_H - 2, Fade(WHITE, 0.5f));
+            }
+        }
+        // Surface detail: a few hairline cracks and patch seams, free once baked
+        static const int cracks[][4] = { {70, 20, 95, 48}, {95, 48, 88, 70}, {330, 120, 352, 131}, {505, 160, 490, 196}, {220, 84, 244, 86} };
+        for (auto &c : cracks) r.line(x0 + c[0], y0 + c[1], x0 + c[2], y0 + c[3], Fade(BLACK, 0.18f));
+        r.rectangleLines(x0 + 400, y0 + 30, 46, 22, Fade(BLACK, 0.12f));
+    }
+
+public:
+    RoadRenderer(): base(), tile(), bakedRoad(0), bakedLine(0), failed(false) {}
+
+    // Re-bakes the layers if the colours changed; true if it did. Call
+    // outside BeginDrawing/EndDrawing (ending texture mode resets the camera).
+    bool prepare(Renderer &r, Color road, Color line) {
+        if (failed || (base.id != 0 && bakedRoad == ColorToInt(road) && bakedLine == ColorToInt(line))) return false;
+        if (base.id == 0) {
+            base = r.loadTarget(ROAD_WIDTH + 2 * SHOULDER, SCREEN_HEIGHT, false);
+            tile = r.loadTarget(ROAD_WIDTH, (int)PERIOD, true);
+            if (base.id == 0 || tile.id == 0) {
+                TraceLog(LOG_WARNING, "ROAD: No render textures for the road; drawing it every frame");
+                unload(r);
+                failed = true;
+                return false;
+            }
+        }
+        r.beginTarget(base, BLANK, true);
+        drawBase(r, 0, 0, road);
+        r.endTarget();
+        r.beginTarget(tile, BLANK, true);
+        drawTile(r, 0, 0, line);
+        r.endTarget();
+        bakedRoad = ColorToInt(road);
+        bakedLine = ColorToInt(line);
+        return true;
+    }
+
+    // `offset` is how far the road has scrolled, in pixels.
+    void draw(Renderer &r, float offset, Color road, Color line) const {
+        if (base.id == 0) { drawDirect(r, offset, road, line); return; }
+        float off = wrapOffset(offset);
+        r.texture(base, (float)(ROAD_X - SHOULDER), 0, WHITE, true);
+        if (!r.quads(1)) return;
+        // Screen row y shows tile row (y - off) mod PERIOD; the texture repeats
+        float v0 = 1.0f + off / PERIOD, v1 = v0 - SCREEN_HEIGHT / PERIOD;
+        BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+        rlSetTexture(tile.texture.id);
+        rlBegin(RL_QUADS);
+        rlColor4ub(255, 255, 255, 255);
+        rlTexCoord2f(0, v0); rlVertex2f((float)ROAD_X, 0);
+        rlTexCoord2f(0, v1); rlVertex2f((float)ROAD_X, (float)SCREEN_HEIGHT);
+        rlTexCoord2f(1, v1); rlVertex2f((float)(ROAD_X + ROAD_WIDTH), (float)SCREEN_HEIGHT);
+        rlTexCoord2f(1, v0); rlVertex2f((float)(ROAD_X + ROAD_WIDTH), 0);
+        rlEnd();
+        rlSetTexture(0);
+        EndBlendMode();
+    }
+
+    // What the baked layers replace: every primitive, every frame.
+    void drawDirect(Renderer &r, float offset, Color road, Color line) const {
+        float off = wrapOffset(offset);
+        drawBase(r, ROAD_X - SHOULDER, 0, road);
+        for (float y = off - PERIOD; y < SCREEN_HEIGHT; y += PERIOD) drawTile(r, ROAD_X, (int)y, line);
+    }
+
+    void unload(Renderer &r) {
+        if (base.id != 0) r.unloadTarget(base);
+        if (tile.id != 0) r.unloadTarget(tile);
+        base = tile = RenderTexture2D();
+    }
+
+private:
+    static float wrapOffset(float offset) {
+        float off = fmodf(offset, PERIOD);
+        return off < 0 ? off + PERIOD : off;
+    }
+};
+
+// -------------------- Renderer Backends --------------------
+// RaylibRenderer is the screen. The null renderer drops everything, so the
+// update and recording cost can be timed alone; RecordingRenderer walks the
+// same layer, road and car code as the screen and counts the draw calls and
+// vertices it issues per frame, optionally writing every call out as text.
+// Neither needs a window, which is what `main --headless` runs on.
+class RaylibRenderer : public Renderer {
+    SceneManager *scene;
+    const RoadRenderer *roadLayers;
+    const CarAtlas *atlas;
+    ParticleSystem *pool;
+    RenderScaler *world;    // null draws the world pass directly, unshaken
+
+public:
+    RaylibRenderer(SceneManager &s, const RoadRenderer &r, const CarAtlas &a, ParticleSystem &p, RenderScaler *w)
+        : scene(&s), roadLayers(&r), atlas(&a), pool(&p), world(w) {}
+
+    void beginWorld(Vector2 shake) override { if (world) world->begin(shake); }
+    void endWorld() override { if (world) world->end(); }
+    void background(const SceneFrame &f) override { scene->drawBackground(f, *this); }
+    void road(float offset, Color road, Color line) override { roadLayers->draw(*this, offset, road, line); }
+    void cars(const Car *c, size_t n) override { atlas->draw(*this, c, n); }
+    void particles(const float *x, const float *y, const float *r, const Color *c, int n) override { pool->drawBatch(*this, x, y, r, c, n); }
+
+    RenderTexture2D loadTarget(int w, int h, bool repeat) override {
+        RenderTexture2D rt = LoadRenderTexture(w, h);
+        if (rt.id != 0 && repeat) SetTextureWrap(rt.texture, TEXTURE_WRAP_REPEAT);
+        return rt;
+    }
+    void unloadTarget(RenderTexture2D &rt) override { UnloadRenderTexture(rt); rt = RenderTexture2D(); }
+    void beginTarget(const RenderTexture2D &rt, Color clear, bool premultiplied) override {
+        BeginTextureMode(rt);
+        ClearBackground(clear);
+        if (premultiplied) beginPremultipliedBake();
+        else beginOpaqueBake();
+    }
+    void endTarget() override { EndBlendMode(); EndTextureMode(); }
+    void texture(const RenderTexture2D &rt, float x, float y, Color tint, bool premultiplied) override {
+        if (premultiplied) BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+        drawRenderTexture(rt, x, y, tint);
+        if (premultiplied) EndBlendMode();
+    }
+    bool quads(int) override { return true; }
+
+    void rectangle(int x, int y, int w, int h, Color c) override { DrawRectangle(x, y, w, h, c); }
+    void rectangleGradientV(int x, int y, int w, int h, Color top, Color bottom) override { DrawRectangleGradientV(x, y, w, h, top, bottom); }
+    void rectangleGradientH(int x, int y, int w, int h, Color left, Color right) override { DrawRectangleGradientH(x, y, w, h, left, right); }
+    void rectangleLines(int x, int y, int w, int h, Color c) override { DrawRectangleLines(x, y, w, h, c); }
+    void rectanglePro(Rectangle r, Vector2 origin, float rotation, Color c) override { DrawRectanglePro(r, origin, rotation, c); }
+    void rectangleRounded(Rectangle r, float roundness, int segments, Color c) override { DrawRectangleRounded(r, roundness, segments, c); }
+    void rectangleRoundedLines(Rectangle r, float roundness, int segments, Color c) override { DrawRectangleRoundedLines(r, roundness, segments, c); }
+    void circle(int x, int y, float radius, Color c) override { DrawCircle(x, y, radius, c); }
+    void circleLines(int x, int y, float radius, Color c) override { DrawCircleLines(x, y, radius, c); }
+    void ellipse(int x, int y, float rx, float ry, Color c) override { DrawEllipse(x, y, rx, ry, c); }
+    void triangle(Vector2 a, Vector2 b, Vector2 c, Color col) override { DrawTriangle(a, b, c, col); }
+    void line(int x0, int y0, int x1, int y1, Color c) override { DrawLine(x0, y0, x1, y1, c); }
+    void text(const char *s, int x, int y, int size, Color c) override { DrawText(s, x, y, size, c); }
+};
+
+class NullRenderer : public Renderer {
+public:
+    void beginWorld(Vector2) override {}
+    void endWorld() override {}
+    void background(const SceneFrame &) override {}
+    void road(float, Color, Color) override {}
+    void cars(const Car *, size_t) override {}
+    void particles(const float *, const float *, const float *, const Color *, int) override {}
+    RenderTexture2D loadTarget(int w, int h, bool) override { return placeholderTarget(w, h); }
+    void unloadTarget(RenderTexture2D &rt) override { rt = RenderTexture2D(); }
+    void beginTarget(const RenderTexture2D &, Color, bool) override {}
+    void endTarget() override {}
+    void texture(const RenderTexture2D &, float, float, Color, bool) override {}
+    bool quads(int) override { return false; }
+    void rectangle(int, int, int, int, Color) override {}
+    void rectangleGradientV(int, int, int, int, Color, Color) override {}
+    void rectangleGradientH(int, int, int, int, Color, Color) override {}
+    void rectangleLines(int, int, int, int, Color) override {}
+    void rectanglePro(Rectangle, Vector2, float, Color) override {}
+    void rectangleRounded(Rectangle, float, int, Color) override {}
+    void rectangleRoundedLines(Rectangle, float, int, Color) override {}
+    void circle(int, int, float, Color) override {}
+    void circleLines(int, int, float, Color) override {}
+    void ellipse(int, int, float, float, Color) override {}
+    void triangle(Vector2, Vector2, Vector2, Color) override {}
+    void line(int, int, int, int, Color) override {}
+    void text(const char *, int, int, int, Color) override {}
+};
+
+// Calls are raylib-level calls as issued (a batch of cars is one); vertex
+// counts follow raylib 5's shape tessellation (36-segment circles and
+// ellipses, quads for rounded corners and triangles, one quad per glyph).
+// Layers are baked into placeholder targets; their calls are traced but
+// not counted, since they are not part of any frame.
+class RecordingRenderer : public Renderer {
+public:
+    struct FrameStats { int calls; long vertices; };
+
+private:
+    SceneManager *scene;
+    const RoadRenderer *roadLayers;
+    const CarAtlas *atlas;
+    ParticleSystem *pool;
+    ostream *trace;         // optional text serialization, one call per line
+    FrameStats cur;
+    vector<FrameStats> frames;
+    bool offscreen;         // between beginTarget() and endTarget()
+
+    static const int CIRCLE_SEGMENTS = 36;
+
+    void count(int calls, long vertices) {
+        if (offscreen) return;
+        cur.calls += calls;
+        cur.vertices += vertices;
+    }
+    static string hex(Color c) { return TextFormat("#%02x%02x%02x%02x", c.r, c.g, c.b, c.a); }
+
+public:
+    RecordingRenderer(SceneManager &s, const RoadRenderer &r, const CarAtlas &a, ParticleSystem &p, ostream *traceOut = nullptr)
+        : scene(&s), roadLayers(&r), atlas(&a), pool(&p), trace(traceOut), cur{0, 0}, offscreen(false) {}
+
+    const vector<FrameStats> &stats() const { return frames; }
+
+    // What `draw` issues through this renderer, as a frame of its own that
+    // is not kept in stats(): for before/after reports.
+    FrameStats measure(const function<void()> &draw) {
+        beginFrame();
+        draw();
+        endFrame();
+        FrameStats s = frames.back();
+        frames.pop_back();
+        return s;
+    }
+
+    void beginFrame() override {
+        cur = FrameStats{0, 0};
+        if (trace) *trace << "frame " << frames.size() << "\n";
+    }
+    void endFrame() override { frames.push_back(cur); }
+
+    void beginWorld(Vector2 shake) override {
+        if (trace) *trace << "begin_world " << shake.x << " " << shake.y << "\n";
+    }
+    void endWorld() override { if (trace) *trace << "end_world\n"; }
+    void background(const SceneFrame &f) override {
+        if (trace) *trace << "background " << SceneManager::sceneName(f.scene) << " " << f.timer << " " << f.crossfade
+                          << (f.cached ? " cached" : "") << "\n";
+        scene->drawBackground(f, *this);
+    }
+    void road(float offset, Color road, Color line) override {
+        if (trace) *trace << "road " << offset << " " << hex(road) << " " << hex(line) << "\n";
+        roadLayers->draw(*this, offset, road, line);
+    }
+    void cars(const Car *c, size_t n) override {
+        if (trace) {
+            *trace << "cars " << n;
+            for (size_t i = 0; i < n; ++i) *trace << " " << c[i].getPos().x << "," << c[i].getPos().y << ":" << c[i].sprite();
+            *trace << "\n";
+        }
+        atlas->draw(*this, c, n);
+    }
+    void particles(const float *x, const float *y, const float *r, const Color *c, int n) override {
+        if (trace) *trace << "particles " << n << "\n";
+        pool->drawBatch(*this, x, y, r, c, n);
+    }
+
+    RenderTexture2D loadTarget(int w, int h, bool) override { return placeholderTarget(w, h); }
+    void unloadTarget(RenderTexture2D &rt) override { rt = RenderTexture2D(); }
+    void beginTarget(const RenderTexture2D &rt, Color clear, bool premultiplied) override {
+        offscreen = true;
+        if (trace) *trace << "begin_target " << rt.id << " " << hex(clear) << (premultiplied ? " premultiplied" : "") << "\n";
+    }
+    void endTarget() override {
+        offscreen = false;
+        if (trace) *trace << "end_target\n";
+    }
+    void texture(const RenderTexture2D &rt, float x, float y, Color tint, bool) override {
+        count(1, 4);
+        if (trace) *trace << "texture " << rt.id << " " << x << " " << y << " " << hex(tint) << "\n";
+    }
+    bool quads(int n) override {
+        count(1, 4L * n);
+        if (trace) *trace << "quads " << n << "\n";
+        return false;
+    }
+
+    void rectangle(int x, int y, int w, int h, Color c) override {
+        count(1, 4);
+        if (trace) *trace << "rect " << x << " " << y << " " << w << " " << h << " " << hex(c) << "\n";
+    }
+    void rectangleGradientV(int x, int y, int w, int h, Color top, Color bottom) override {
+        count(1, 4);
+        if (trace) *trace << "rect_gradient_v " << x << " " << y << " " << w << " " << h << " " << hex(top) << " " << hex(bottom) << "\n";
+    }
+    void rectangleGradientH(int x, int y, int w, int h, Color left, Color right) override {
+        count(1, 4);
+        if (trace) *trace << "rect_gradient_h " << x << " " << y << " " << w << " " << h << " " << hex(left) << " " << hex(right) << "\n";
+    }
+    void rectangleLines(int x, int y, int w, int h, Color c) override {
+        count(1, 8);
+        if (trace) *trace << "rect_lines " << x << " " << y << " " << w << " " << h << " " << hex(c) << "\n";
+    }
+    void rectanglePro(Rectangle r, Vector2 origin, float rotation, Color c) override {
+        count(1, 4);
+        if (trace) *trace << "rect_pro " << r.x << " " << r.y << " " << r.width << " " << r.height << " "
+                          << origin.x << " " << origin.y << " " << rotation << " " << hex(c) << "\n";
+    }
+    void rectangleRounded(Rectangle r, float roundness, int segments, Color c) override {
+        count(1, 8L * segments + 20);      // corner quads + five rectangles
+        if (trace) *trace << "rect_rounded " << r.x << " " << r.y << " " << r.width << " " << r.height << " "
+                          << roundness << " " << segments << " " << hex(c) << "\n";
+    }
+    void rectangleRoundedLines(Rectangle r, float roundness, int segments, Color c) override {
+        count(1, 8L * segments + 8);       // corner arcs + four sides, as lines
+        if (trace) *trace << "rect_rounded_lines " << r.x << " " << r.y << " " << r.width << " " << r.height << " "
+                          << roundness << " " << segments << " " << hex(c) << "\n";
+    }
+    void circle(int x, int y, float radius, Color c) override {
+        count(1, CIRCLE_SEGMENTS / 2 * 4);
+        if (trace) *trace << "circle " << x << " " << y << " " << radius << " " << hex(c) << "\n";
+    }
+    void circleLines(int x, int y, float radius, Color c) override {
+        count(1, CIRCLE_SEGMENTS * 2);
+        if (trace) *trace << "circle_lines " << x << " " << y << " " << radius << " " << hex(c) << "\n";
+    }
+    void ellipse(int x, int y, float rx, float ry, Color c) override {
+        count(1, CIRCLE_SEGMENTS * 3);
+        if (trace) *trace << "ellipse " << x << " " << y << " " << rx << " " << ry << " " << hex(c) << "\n";
+    }
+    void triangle(Vector2 a, Vector2 b, Vector2 c, Color col) override {
+        count(1, 4);
+        if (trace) *trace << "triangle " << a.x << " " << a.y << " " << b.x << " " << b.y << " " << c.x << " " << c.y << " " << hex(col) << "\n";
+    }
+    void line(int x0, int y0, int x1, int y1, Color c) override {
+        count(1, 2);
+        if (trace) *trace << "line " << x0 << " " << y0 << " " << x1 << " " << y1 << " " << hex(c) << "\n";
+    }
+    void text(const char *s, int x, int y, int size, Color c) override {
+        long glyphs = 0;
+        for (const char *p = s; *p; ++p) if (*p != ' ') glyphs++;
+        count(1, 4 * glyphs);
+        if (trace) *trace << "text " << x << " " << y << " " << size << " " << hex(c) << " " << s << "\n";
+    }
+};
+
+// -------------------- Draw List --------------------
+// A gameplay frame recorded as compact commands instead of raylib calls.
+// Text, cars and particles are copied into the list's own arrays, so once
+// recorded it no longer reads game state: the game submits frame N from
+// one list on the main thread while a job updates frame N+1 and records it
+// into the other. Arrays are cleared, not freed, between frames.
+enum DrawOp : uint8_t {
+    DRAW_BEGIN_WORLD,       // x, y: camera shake
+    DRAW_END_WORLD,
+    DRAW_BACKGROUND,        // the list's scene frame
+    DRAW_ROAD,              // x: scroll offset; color: road, color2: lines
+    DRAW_CARS,              // cars[first, first + count)
+    DRAW_PARTICLES,         // particle arrays [first, first + count)
+    DRAW_RECT,
+    DRAW_RECT_GRADIENT_V,   // color: top, color2: bottom
+    DRAW_RECT_PRO,          // p0, p1: origin; p2: rotation
+    DRAW_RECT_ROUNDED,      // p0: roundness
+    DRAW_RECT_ROUNDED_LINES,
+    DRAW_CIRCLE,            // w: radius
+    DRAW_CIRCLE_LINES,
+    DRAW_TEXT               // text at `first`; h: font size
+};
+
+struct DrawCmd {
+    DrawOp op;
+    uint8_t segments;
+    Color color, color2;
+    float x, y, w, h;
+    float p0, p1, p2;
+    uint32_t first, count;
+};
+
+class DrawList {
+    vector<DrawCmd> cmds;
+    vector<char> strings;
+    vector<Car> cars;
+    vector<float> px, py, pr;
+    vector<Color> pc;
+    SceneManager::Frame background;
+
+    DrawCmd &push(DrawOp op, Color c = BLANK) {
+        DrawCmd d;
+        memset(&d, 0, sizeof(d));
+        d.op = op;
+        d.color = c;
+        cmds.push_back(d);
+        return cmds.back();
+    }
+
+    static Rectangle rect(const DrawCmd &d) { return (Rectangle){d.x, d.y, d.w, d.h}; }
+
+public:
+    DrawList() { memset(&background, 0, sizeof(background)); }
+
+    void clear() {
+        cmds.clear(); strings.clear(); cars.clear();
+        px.clear(); py.clear(); pr.clear(); pc.clear();
+    }
+    size_t size() const { return cmds.size(); }
+
+    // Set on the main thread, between the update that recorded the list and
+    // the next one, while the scene state matches it.
+    void setBackground(const SceneManager::Frame &f) { background = f; }
+    bool backgroundCached() const { return background.cached; }
+
+    void beginWorld(Vector2 shake) { DrawCmd &d = push(DRAW_BEGIN_WORLD); d.x = shake.x; d.y = shake.y; }
+    void endWorld() { push(DRAW_END_WORLD); }
+    void sceneBackground() { push(DRAW_BACKGROUND); }
+    void road(float offset, Color road, Color line) { DrawCmd &d = push(DRAW_ROAD, road); d.color2 = line; d.x = offset; }
+
+    void carSprites(const Car *c, size_t n) {
+        DrawCmd &d = push(DRAW_CARS);
+        d.first = (uint32_t)cars.size();
+        d.count = (uint32_t)n;
+        cars.insert(cars.end(), c, c + n);
+    }
+
+    void particles(const ParticleSystem &ps) {
+        DrawCmd &d = push(DRAW_PARTICLES);
+        d.first = (uint32_t)px.size();
+        ps.snapshot(px, py, pr, pc);
+        d.count = (uint32_t)(px.size() - d.first);
+    }
+
+    void rectangle(float x, float y, float w, float h, Color c) {
+        DrawCmd &d = push(DRAW_RECT, c); d.x = x; d.y = y; d.w = w; d.h = h;
+    }
+    void rectangleGradientV(float x, float y, float w, float h, Color top, Color bottom) {
+        DrawCmd &d = push(DRAW_RECT_GRADIENT_V, top); d.color2 = bottom; d.x = x; d.y = y; d.w = w; d.h = h;
+    }
+    void rectanglePro(Rectangle r, Vector2 origin, float rotation, Color c) {
+        DrawCmd &d = push(DRAW_RECT_PRO, c); d.x = r.x; d.y = r.y; d.w = r.width; d.h = r.height;
+        d.p0 = origin.x; d.p1 = origin.y; d.p2 = rotation;
+    }
+    void rectangleRounded(Rectangle r, float roundness, int segments, Color c, bool lines = false) {
+        DrawCmd &d = push(lines ? DRAW_RECT_ROUNDED_LINES : DRAW_RECT_ROUNDED, c);
+        d.x = r.x; d.y = r.y; d.w = r.width; d.h = r.height; d.p0 = roundness; d.segments = (uint8_t)segments;
+    }
+    void circle(float x, float y, float radius, Color c, bool lines = false) {
+        DrawCmd &d = push(lines ? DRAW_CIRCLE_LINES : DRAW_CIRCLE, c); d.x = x; d.y = y; d.w = radius;
+    }
+
+    void textf(float x, float y, int size, Color c, const char *fmt, ...) {
+        char buf[256];
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        DrawCmd &d = push(DRAW_TEXT, c); d.x = x; d.y = y; d.h = (float)size;
+        d.first = (uint32_t)strings.size();
+        strings.insert(strings.end(), buf, buf + strlen(buf) + 1);
+    }
+    void text(const char *s, float x, float y, int size, Color c) { textf(x, y, size, c, "%s", s); }
+
+    // Coordinates are truncated to ints where the raylib call takes ints,
+    // as the direct calls did. On the screen renderer: main thread, inside
+    // BeginDrawing.
+    void submit(Renderer &r) const {
+        for (const DrawCmd &d : cmds) {
+            switch (d.op) {
+                case DRAW_BEGIN_WORLD: r.beginWorld((Vector2){d.x, d.y}); break;
+                case DRAW_END_WORLD: r.endWorld(); break;
+                case DRAW_BACKGROUND: r.background(background); break;
+                case DRAW_ROAD: r.road(d.x, d.color, d.color2); break;
+                case DRAW_CARS: r.cars(cars.data() + d.first, d.count); break;
+                case DRAW_PARTICLES: r.particles(px.data() + d.first, py.data() + d.first, pr.data() + d.first, pc.data() + d.first, (int)d.count); break;
+                case DRAW_RECT: r.rectangle((int)d.x, (int)d.y, (int)d.w, (int)d.h, d.color); break;
+                case DRAW_RECT_GRADIENT_V: r.rectangleGradientV((int)d.x, (int)d.y, (int)d.w, (int)d.h, d.color, d.color2); break;
+                case DRAW_RECT_PRO: r.rectanglePro(rect(d), (Vector2){d.p0, d.p1}, d.p2, d.color); break;
+                case DRAW_RECT_ROUNDED: r.rectangleRounded(rect(d), d.p0, d.segments, d.color); break;
+                case DRAW_RECT_ROUNDED_LINES: r.rectangleRoundedLines(rect(d), d.p0, d.segments, d.color); break;
+                case DRAW_CIRCLE: r.circle((int)d.x, (int)d.y, d.w, d.color); break;
+                case DRAW_CIRCLE_LINES: r.circleLines((int)d.x, (int)d.y, d.w, d.color); break;
+                case DRAW_TEXT: r.text(strings.data() + d.first, (int)d.x, (int)d.y, (int)d.h, d.color); break;
+            }
+        }
+    }
+};
+
+// -------------------- PowerUp --------------------
+class PowerUp {
+private:
+    Position pos;
+    PowerUpType type;
+    Color color;
+    float rot, pulse;
+    bool collected;
+public:
+    PowerUp(float x, float y, PowerUpType t) : pos(x,y), type(t), rot(0), pulse(0), collected(false) {
+        switch(t) { case SHIELD: color = SKYBLUE; break; case SLOW_MOTION: color = PURPLE; break; case SCORE_MULTIPLIER: color = GOLD; break; case EXTRA_LIFE: color = RED; break; }
+    }
+    void update() { pos.y += 2.5f; rot += 3.0f; pulse += 0.08f; }
+    void draw(DrawList &dl) const {
+        if (collected) return;
+        float psize = 30 + sin(pulse) * 5;
+        dl.circle(pos.x, pos.y, psize + 10, Fade(color, 0.2f));
+        dl.circle(pos.x, pos.y, psize + 5, Fade(color, 0.3f));
+        dl.circle(pos.x, pos.y, psize, Fade(color, 0.4f));
+        Rectangle r = { pos.x - 17.5f, pos.y - 17.5f, 35, 35 };
+        dl.rectanglePro(r, (Vector2){17.5f,17.5f}, rot, color);
+        Rectangle i = { pos.x - 12.5f, pos.y - 12.5f, 25, 25 };
+        dl.rectanglePro(i, (Vector2){12.5f,12.5f}, -rot*1.5f, Fade(WHITE, 0.5f));
+        const char* s = "";
+        switch(type) { case SHIELD: s="S"; break; case SLOW_MOTION: s="T"; break; case SCORE_MULTIPLIER: s="X"; break; case EXTRA_LIFE: s="H"; break; }
+        dl.text(s, (int)(pos.x - 8), (int)(pos.y - 12), 25, WHITE);
+    }
+    CollisionBox box() const { return { pos.x - 20, pos.y - 20, 40, 40 }; }
+    Position getPos() const { return pos; }
+    PowerUpType getType() const { return type; }
+    bool isCollected() const { return collected; }
+    void setCollected(bool v) { collected = v; }
+    void setPos(float x, float y) { pos.x = x; pos.y = y; }
+};
+
+// -------------------- ActivePowerUp --------------------
+struct ActivePowerUp { PowerUpType type; float timeRemaining; ActivePowerUp(PowerUpType t, float tm): type(t), timeRemaining(tm) {} };
+
+// -------------------- Event Scheduler --------------------
+struct Event {
+    uint64_t tick;
+    function<void()> action;
+    bool operator>(const Event &o) const { return tick > o.tick; }
+};
+class EventScheduler {
+    priority_queue<Event, vector<Event>, greater<Event>> pq;
+    mutex mtx;
+    uint64_t lastTick = 0;
+public:
+    uint64_t now() const { return lastTick; }
+    void scheduleAt(uint64_t tick, function<void()> action) {
+        lock_guard<mutex> lk(mtx);
+        pq.push(Event{tick, action});
+    }
+    void scheduleAfter(uint64_t nowTick, uint64_t afterFrames, function<void()> action) {
+        scheduleAt(nowTick + afterFrames, action);
+    }
+    void process(uint64_t currentTick) {
+        lastTick = currentTick;
+        vector<Event> toRun;
+        {
+            lock_guard<mutex> lk(mtx);
+            while (!pq.empty() && pq.top().tick <= currentTick) {
+                toRun.push_back(pq.top()); pq.pop();
+            }
+        }
+        for (auto &e : toRun) {
+            if (e.action) e.action();
+        }
+    }
+    void clear() {
+        lock_guard<mutex> lk(mtx);
+        while (!pq.empty()) pq.pop();
+    }
+};
+
+// -------------------- Spawn Scripts (coroutines) --------------------
+// Spawn waves are written as plain sequential code that co_awaits frames or
+// signals. A suspended script is just its frame plus (at most) one pending
+// scheduler event or signal entry; nothing runs for it until it wakes.
+
+// Free-list pool for coroutine frames, in a few size classes. Scripts are
+// created and destroyed on the main thread only, so no locking.
+class CoroFramePool {
+    static const size_t CLASS_SIZES[3];
+    struct FreeBlock { FreeBlock *next; };
+    FreeBlock *freeLists[3] = { nullptr, nullptr, nullptr };
+    vector<unique_ptr<char[]>> slabs;
+    size_t live = 0;
+
+    static int classFor(size_t n) {
+        for (int c = 0; c < 3; ++c) if (n <= CLASS_SIZES[c]) return c;
+        return -1;
+    }
+    void refill(int c) {
+        const size_t perSlab = 64;
+        slabs.push_back(unique_ptr<char[]>(new char[CLASS_SIZES[c] * perSlab]));
+        char *base = slabs.back().get();
+        for (size_t i = 0; i < perSlab; ++i) {
+            FreeBlock *b = (FreeBlock*)(base + i * CLASS_SIZES[c]);
+            b->next = freeLists[c];
+            freeLists[c] = b;
+        }
+    }
+public:
+    static CoroFramePool &instance() { static CoroFramePool pool; return pool; }
+    void *allocate(size_t n) {
+        live++;
+        int c = classFor(n);
+        if (c < 0) return ::operator new(n);
+        if (!freeLists[c]) refill(c);
+        FreeBlock *b = freeLists[c];
+        freeLists[c] = b->next;
+        return b;
+    }
+    void deallocate(void *p, size_t n) {
+        live--;
+        int c = classFor(n);
+        if (c < 0) { ::operator delete(p); return; }
+        FreeBlock *b = (FreeBlock*)p;
+        b->next = freeLists[c];
+        freeLists[c] = b;
+    }
+    size_t liveFrames() const { return live; }
+};
+const size_t CoroFramePool::CLASS_SIZES[3] = { 256, 512, 1024 };
+
+enum ScriptSignalId { SIGNAL_LEVEL_UP, SIGNAL_SCENE_CHANGE, SIGNAL_PLAYER_HIT, SIGNAL_COUNT };
+
+class ScriptRunner;
+
+class SpawnScript {
+public:
+    struct promise_type {
+        ScriptRunner *runner = nullptr;
+        promise_type *prev = nullptr, *next = nullptr; // runner's live list
+
+        SpawnScript get_return_object() { return SpawnScript(coroutine_handle<promise_type>::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; } // started by ScriptRunner::start
+        struct Retire {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(coroutine_handle<promise_type> h) noexcept;
+            void await_resume() noexcept {}
+        };
+        Retire final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {
+            TraceLog(LOG_WARNING, "SCRIPT: Spawn script stopped: %s", describeError(current_exception()).c_str());
+        }
+        static void *operator new(size_t n) { return CoroFramePool::instance().allocate(n); }
+        static void operator delete(void *p, size_t n) { CoroFramePool::instance().deallocate(p, n); }
+    };
+
+    SpawnScript(SpawnScript &&o) noexcept : handle(o.handle) { o.handle = nullptr; }
+    ~SpawnScript() { if (handle) handle.destroy(); } // never started
+private:
+    friend class ScriptRunner;
+    explicit SpawnScript(coroutine_handle<promise_type> h): handle(h) {}
+    coroutine_handle<promise_type> handle;
+};
+
+// Owns every live script. Wake-ups are EventScheduler events, tagged with
+// a generation so events outliving a clear() become no-ops.
+class ScriptRunner {
+    typedef coroutine_handle<SpawnScript::promise_type> Handle;
+    struct SignalWaiter { Handle h; function<bool()> pred; };
+
+    EventScheduler &scheduler;
+    SpawnScript::promise_type *liveHead = nullptr;
+    size_t liveCount = 0;
+    uint64_t generation = 0;
+    uint64_t wakeTick = 0;
+    vector<SignalWaiter> waiters[SIGNAL_COUNT];
+
+    void link(SpawnScript::promise_type &p) {
+        p.runner = this;
+        p.next = liveHead;
+        if (liveHead) liveHead->prev = &p;
+        liveHead = &p;
+        liveCount++;
+    }
+
+    void wakeAt(uint64_t tick, Handle h) {
+        uint64_t gen = generation;
+        scheduler.scheduleAt(tick, [this, gen, tick, h]() {
+            if (gen != generation) return;
+            wakeTick = tick;
+            h.resume();
+        });
+    }
+
+public:
+    explicit ScriptRunner(EventScheduler &sched): scheduler(sched) {}
+    ~ScriptRunner() { clear(); }
+
+    size_t live() const { return liveCount; }
+
+    // First resume happens when the scheduler reaches `atTick`.
+    void start(SpawnScript script, uint64_t atTick) {
+        Handle h = script.handle;
+        script.handle = nullptr;
+        link(h.promise());
+        wakeAt(atTick, h);
+    }
+
+    void retire(Handle h) {
+        SpawnScript::promise_type &p = h.promise();
+        if (p.prev) p.prev->next = p.next; else liveHead = p.next;
+        if (p.next) p.next->prev = p.prev;
+        liveCount--;
+        h.destroy();
+    }
+
+    // Destroys every suspended script; pending wake-ups are invalidated.
+    void clear() {
+        generation++;
+        for (auto &w : waiters) w.clear();
+        while (liveHead) retire(Handle::from_promise(*liveHead));
+    }
+
+    // Wakes scripts waiting on `id` whose condition now holds.
+    void raise(ScriptSignalId id) {
+        vector<SignalWaiter> list;
+        list.swap(waiters[id]);
+        uint64_t gen = generation;
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (gen != generation) break; // a woken script cleared the runner
+            if (!list[i].pred || list[i].pred()) list[i].h.resume();
+            else waiters[id].push_back(list[i]);
+        }
+    }
+
+    // co_await scripts.frames(n): resume n frames after the current wake-up.
+    struct FramesAwaiter {
+        ScriptRunner &r; uint64_t n;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(Handle h) { r.wakeAt(r.wakeTick + max<uint64_t>(1, n), h); }
+        void await_resume() const noexcept {}
+    };
+    FramesAwaiter frames(uint64_t n) { return FramesAwaiter{*this, n}; }
+
+    // co_await scripts.until(signal, pred): checked only when `signal` is raised.
+    struct SignalAwaiter {
+        ScriptRunner &r; ScriptSignalId id; function<bool()> pred;
+        bool await_ready() const { return pred && pred(); }
+        void await_suspend(Handle h) { r.waiters[id].push_back(SignalWaiter{h, pred}); }
+        void await_resume() {
+            r.wakeTick = r.scheduler.now();
+        }
+    };
+    SignalAwaiter until(ScriptSignalId id, function<bool()> pred = nullptr) { return SignalAwaiter{*this, id, move(pred)}; }
+};
+
+inline void SpawnScript::promise_type::Retire::await_suspend(coroutine_handle<promise_type> h) noexcept {
+    h.promise().runner->retire(h);
+}
+
+// -------------------- Frame Task Graph --------------------
+// Per-frame update phases declare which parts of the game state they read
+// and write. A task waits for every earlier task it conflicts with, so the
+// outcome is identical to running the tasks serially in declaration order.
+enum FrameResource : uint32_t {
+    RES_SCENE          = 1u << 0,
+    RES_PLAYER         = 1u << 1,
+    RES_CAMERA         = 1u << 2,
+    RES_ENEMIES        = 1u << 3,
+    RES_POWERUPS       = 1u << 4,
+    RES_BROADPHASE     = 1u << 5,
+    RES_ACTIVE_POWERUPS = 1u << 6,
+    RES_SCORE          = 1u << 7,
+    RES_LIVES          = 1u << 8,
+    RES_PARTICLES      = 1u << 9,
+    RES_AUDIO          = 1u << 10,
+    RES_RNG            = 1u << 11  // rand() sequence: keeps spawns/effects reproducible
+};
+
+class FrameTaskGraph {
+    struct Task {
+        const char *name;
+        uint32_t reads, writes;
+        function<void()> fn;
+        vector<int> dependents;
+        int dependencies;
+    };
+    // Per-run bookkeeping; shared with pool jobs that may outlive run()
+    struct RunState {
+        mutex mtx;
+        condition_variable cv;
+        deque<int> ready;
+        vector<int> remaining;
+        int finished = 0;
+        exception_ptr error;
+    };
+    vector<Task> tasks;
+    bool compiled;
+
+    void compile() {
+        for (auto &t : tasks) { t.dependents.clear(); t.dependencies = 0; }
+        for (size_t j = 0; j < tasks.size(); ++j) {
+            for (size_t i = 0; i < j; ++i) {
+                const Task &a = tasks[i], &b = tasks[j];
+                bool conflict = (a.writes & (b.reads | b.writes)) || (a.reads & b.writes);
+                if (conflict) { tasks[i].dependents.push_back((int)j); tasks[j].dependencies++; }
+            }
+        }
+        compiled = true;
+    }
+
+    // Runs one ready task if there is one; returns false when none was available.
+    bool runOne(const shared_ptr<RunState> &rs, JobQueue &pool) {
+        int idx;
+        {
+            lock_guard<mutex> lk(rs->mtx);
+            if (rs->ready.empty()) return false;
+            idx = rs->ready.front();
+            rs->ready.pop_front();
+        }
+        try {
+            tasks[idx].fn();
+        } catch (...) {
+            lock_guard<mutex> lk(rs->mtx);
+            if (!rs->error) rs->error = current_exception();
+        }
+        int released = 0;
+        {
+            lock_guard<mutex> lk(rs->mtx);
+            for (int d : tasks[idx].dependents) {
+                if (--rs->remaining[d] == 0) { rs->ready.push_back(d); released++; }
+            }
+            rs->finished++;
+        }
+        // The calling thread keeps one released task for itself (via its loop)
+        for (int k = 1; k < released; ++k) pool.push([this, rs, &pool]{ while (runOne(rs, pool)) {} });
+        rs->cv.notify_all();
+        return true;
+    }
+
+public:
+    FrameTaskGraph(): compiled(false) {}
+    void add(const char *name, uint32_t reads, uint32_t writes, function<void()> fn) {
+        tasks.push_back(Task{name, reads, writes, move(fn), {}, 0});
+        compiled = false;
+    }
+    size_t size() const { return tasks.size(); }
+
+    // Executes the graph on the pool; the calling thread helps and returns
+    // once every task has run. The first task exception is rethrown here.
+    void run(JobQueue &pool) {
+        if (!compiled) compile();
+        auto rs = make_shared<RunState>();
+        rs->remaining.resize(tasks.size());
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            rs->remaining[i] = tasks[i].dependencies;
+            if (tasks[i].dependencies == 0) rs->ready.push_back((int)i);
+        }
+        // Counted up front: the helpers start taking from `ready` as they are pushed
+        size_t initial = rs->ready.size();
+        for (size_t k = 1; k < initial; ++k) pool.push([this, rs, &pool]{ while (runOne(rs, pool)) {} });
+        while (true) {
+            if (runOne(rs, pool)) continue;
+            unique_lock<mutex> lk(rs->mtx);
+            rs->cv.wait(lk, [&]{ return !rs->ready.empty() || rs->finished == (int)tasks.size(); });
+            if (rs->finished == (int)tasks.size()) break;
+        }
+        if (rs->error) rethrow_exception(rs->error);
+    }
+
+    // Same results, no pool: handy when comparing against the parallel path.
+    void runSerial() {
+        for (auto &t : tasks) t.fn();
+    }
+};
+
+// Splits [0, n) into chunks of `grain` and runs fn(begin, end) across the
+// pool. The caller claims chunks too, so this is safe to call from a job.
+template <typename F>
+static void parallelFor(JobQueue &pool, int n, int grain, F fn) {
+    if (n <= grain) { if (n > 0) fn(0, n); return; }
+    struct State { atomic<int> next; atomic<int> done; int n, grain, chunks; mutex mtx; condition_variable cv; };
+    auto st = make_shared<State>();
+    st->next = 0; st->done = 0; st->n = n; st->grain = grain; st->chunks = (n + grain - 1) / grain;
+    auto work = [st, fn]() {
+        int c;
+        while ((c = st->next++) < st->chunks) {
+            int b = c * st->grain;
+            fn(b, min(st->n, b + st->grain));
+            if (++st->done == st->chunks) { lock_guard<mutex> lk(st->mtx); st->cv.notify_all(); }
+        }
+    };
+    int helpers = min(st->chunks - 1, pool.threadCount());
+    for (int i = 0; i < helpers; ++i) pool.push(work);
+    work();
+    unique_lock<mutex> lk(st->mtx);
+    st->cv.wait(lk, [&]{ return st->done.load() == st->chunks; });
+}
+
+// -------------------- EnemyManager --------------------
+class EnemyManager {
 private:
-    Position pos;
-    PowerUpType type;
-    Color color;
-    float rot, pulse;
-    bool collected;
+    vector<Car> enemies;
+    int level;
+public:
+    EnemyManager(): level(1) {}
+    const vector<Car>& getEnemies() const { return enemies; }
+    int getLevel() const { return level; }
+    void reset() { enemies.clear(); level = 1; }
+    void setLevel(int newLevel) {
+        if (newLevel < 1) newLevel = 1;
+        if (newLevel > MAX_LEVEL) newLevel = MAX_LEVEL;
+        level = newLevel;
+    }
+    static float laneCenterX(int lane) { return ROAD_X + 60 + lane * LANE_WIDTH; }
+
+    void spawnAtLane(int chosen) {
+        if (chosen < 0 || chosen >= NUM_LANES) return;
+        float base = 2.2f;
+        float speed = base + pow((float)level, 1.15f) * 0.16f + (rand()%100)/100.0f;
+        enemies.push_back(Car(laneCenterX(chosen), -120.0f, chosen, speed, CAR_COLORS[rand() % NUM_CAR_COLORS]));
+    }
+
+    // Frames until the base traffic script spawns its next car.
+    static int trafficInterval(int level) {
+        float spawnBase = 85.0f - level * 0.65f;
+        float spawn = std::max(7.0f, spawnBase + (rand()%20 - 10));
+        return (int)std::max(7.0f, spawn);
+    }
+
+    int chooseSafeLane() {
+        const float nearY = 200.0f;
+        const float extendedY = 330.0f;
+        vector<int> candidate;
+        for (int lane = 0; lane < NUM_LANES; ++lane) {
+            bool occupiedNear = false;
+            for (auto &e : enemies) {
+                if (e.getLane() == lane && e.getPos().y < nearY) { occupiedNear = true; break; }
+            }
+            if (!occupiedNear) candidate.push_back(lane);
+        }
+        vector<int> safe;
+        for (int lane : candidate) {
+            bool adjBlocked = false;
+            for (auto &e : enemies) {
+                if (e.getPos().y < extendedY && abs(e.getLane() - lane) == 1) { adjBlocked = true; break; }
+            }
+            if (!adjBlocked) safe.push_back(lane);
+        }
+        int chosen = -1;
+        if (!safe.empty()) chosen = safe[rand() % safe.size()];
+        else if (!candidate.empty()) chosen = candidate[rand() % candidate.size()];
+        return chosen;
+    }
+
+    void update(bool slowMotion, JobQueue *pool = nullptr) {
+        float speedMult = slowMotion ? 0.5f : 1.0f;
+        if (pool) {
+            parallelFor(*pool, (int)enemies.size(), 512, [this, speedMult](int b, int e) {
+                for (int i = b; i < e; ++i) enemies[i].update(speedMult);
+            });
+        } else {
+            for (size_t i=0;i<enemies.size();++i) {
+                enemies[i].update(speedMult);
+            }
+        }
+        enemies.erase(remove_if(enemies.begin(), enemies.end(),
+                    [](const Car &c){ return c.getPos().y > SCREEN_HEIGHT + 150; }), enemies.end());
+    }
+
+    void draw(DrawList &dl) const { dl.carSprites(enemies.data(), enemies.size()); }
+};
+
+// -------------------- PowerUpManager --------------------
+class PowerUpManager {
+private:
+    vector<PowerUp> list;
+public:
+    PowerUpManager() {}
+    vector<PowerUp>& getPowerUps() { return list; }
+    void reset() { list.clear(); }
+
+    static float laneCenterX(int lane) { return ROAD_X + 60 + lane * LANE_WIDTH; }
+
+    void spawnAtLane(int lane) {
+        if (lane < 0 || lane >= NUM_LANES) return;
+        PowerUpType types[] = { SHIELD, SLOW_MOTION, SCORE_MULTIPLIER, EXTRA_LIFE };
+        PowerUpType t = types[rand() % 4];
+        list.push_back(PowerUp(laneCenterX(lane), -80.0f, t));
+    }
+
+    int chooseFreeLaneBasedOnEnemies(const EnemyManager &enemyMgr) {
+        const float safeY = 320.0f;
+        vector<int> freeLanes;
+        for (int lane = 0; lane < NUM_LANES; ++lane) {
+            bool blocked = false;
+            for (auto &e : enemyMgr.getEnemies()) {
+                if (e.getLane() == lane && e.getPos().y < safeY) { blocked = true; break; }
+            }
+            if (!blocked) freeLanes.push_back(lane);
+        }
+        if (!freeLanes.empty()) return freeLanes[rand() % freeLanes.size()];
+        return -1;
+    }
+
+    void update() {
+        for (auto &p : list) p.update();
+        list.erase(remove_if(list.begin(), list.end(),
+            [](const PowerUp &u){ return u.getPos().y > SCREEN_HEIGHT + 120 || u.isCollected(); }), list.end());
+    }
+    void draw(DrawList &dl) const { for (auto &p : list) p.draw(dl); }
+};
+
+// -------------------- Durable File Writer --------------------
+// Replaces `path` atomically: write a sibling temp file, flush it to disk,
+// then rename over the target. A crash leaves either the old or the new file.
+static void syncFile(FILE *f) {
+#ifdef _WIN32
+    _commit(_fileno(f));
+#else
+    fsync(fileno(f));
+#endif
+}
+
+static void syncParentDir(const string &path) {
+#ifndef _WIN32
+    string dir = filesystem::path(path).parent_path().string();
+    int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0) { fsync(fd); close(fd); }
+#else
+    (void)path;
+#endif
+}
+
+static void writeFileDurably(const string &tmpPath, const string &bytes) {
+    FILE *f = fopen(tmpPath.c_str(), "wb");
+    if (!f) throw runtime_error("cannot open " + tmpPath + " for writing");
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    ok = fflush(f) == 0 && ok;
+    if (ok) syncFile(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) { remove(tmpPath.c_str()); throw runtime_error("failed writing " + tmpPath); }
+}
+
+// Coalesces snapshot saves for one file. Saves requested while a write is in
+// flight collapse into a single follow-up write of the newest snapshot, and
+// a generation check at rename time means an older write can never replace
+// a newer one, whichever thread performs it.
+class SnapshotWriter {
+    struct State {
+        string path;
+        mutex mtx;              // pending snapshot + waiters
+        condition_variable cv;
+        string pending;
+        int pendingEntries = 0;
+        uint64_t pendingGen = 0;
+        uint64_t committedGen = 0;
+        bool jobQueued = false;
+        vector<Promise<int>> waiters;
+        mutex renameMtx;        // only held around the generation check + rename
+        atomic<uint64_t> tmpSeq{0};
+
+        // Writes snapshot `gen`; returns false if a newer one was already committed.
+        // Every call gets its own temp file: a flush can commit the same
+        // generation as a drain job that is still writing.
+        bool commit(const string &bytes, uint64_t gen) {
+            string tmp = path + ".tmp" + to_string(gen) + "." + to_string(++tmpSeq);
+            writeFileDurably(tmp, bytes);
+            lock_guard<mutex> lk(renameMtx);
+            if (gen <= committedGen) { remove(tmp.c_str()); return false; }
+            error_code ec;
+            filesystem::rename(tmp, path, ec);
+            if (ec) { remove(tmp.c_str()); throw runtime_error("cannot replace " + path + ": " + ec.message()); }
+            syncParentDir(path);
+            {
+                lock_guard<mutex> slk(mtx);
+                committedGen = gen;
+            }
+            cv.notify_all();
+            return true;
+        }
+    };
+    shared_ptr<State> st;
+
+    static void drain(shared_ptr<State> st) {
+        while (true) {
+            string bytes; int entries; uint64_t gen;
+            vector<Promise<int>> done;
+            {
+                lock_guard<mutex> lk(st->mtx);
+                bytes = st->pending; entries = st->pendingEntries; gen = st->pendingGen;
+                done.swap(st->waiters);
+            }
+            exception_ptr err;
+            try {
+                st->commit(bytes, gen);
+            } catch (...) {
+                err = current_exception();
+            }
+            for (auto &p : done) { if (err) p.setError(err); else p.setValue(entries); }
+            lock_guard<mutex> lk(st->mtx);
+            if (st->pendingGen == gen) { st->jobQueued = false; return; }
+        }
+    }
+
+public:
+    explicit SnapshotWriter(const string &path): st(make_shared<State>()) { st->path = path; }
+
+    // Resolves once a write covering this snapshot has landed (or failed).
+    Future<int> save(JobQueue &jobs, JobStream stream, string bytes, int entries) {
+        Promise<int> p;
+        bool schedule;
+        {
+            lock_guard<mutex> lk(st->mtx);
+            st->pending = move(bytes);
+            st->pendingEntries = entries;
+            st->pendingGen++;
+            st->waiters.push_back(p);
+            schedule = !st->jobQueued;
+            st->jobQueued = true;
+        }
+        if (schedule) {
+            shared_ptr<State> s = st;
+            jobs.push(stream, [s]() { drain(s); });
+        }
+        return p.future();
+    }
+
+    // Waits up to `seconds` for the newest snapshot to be committed; after
+    // that it is written from the calling thread. Returns false on failure.
+    bool flush(double seconds) {
+        string bytes; uint64_t gen;
+        {
+            unique_lock<mutex> lk(st->mtx);
+            if (st->cv.wait_for(lk, chrono::duration<double>(seconds),
+                                [this]{ return st->committedGen >= st->pendingGen; })) return true;
+            bytes = st->pending; gen = st->pendingGen;
+        }
+        try {
+            st->commit(bytes, gen);
+        } catch (const exception &e) {
+            TraceLog(LOG_WARNING, "SCORES: Flush failed: %s", e.what());
+            return false;
+        }
+        return true;
+    }
+
+    // Synchronous write of a snapshot, still atomic and generation-ordered.
+    void saveNow(string bytes) {
+        uint64_t gen;
+        {
+            lock_guard<mutex> lk(st->mtx);
+            st->pending = bytes;    // a drain job may read or replace it once unlocked
+            gen = ++st->pendingGen;
+        }
+        st->commit(bytes, gen);
+    }
+};
+
+// -------------------- Score File (binary, versioned) --------------------
+// Layout: header | block CRC table | fixed-width records, best score first
+// [| sketch section, version 2+]. The header CRC covers the header and the
+// CRC table; each block of records has its own CRC and is only verified when
+// read. Loading the top-K therefore touches the header plus one block,
+// however many records the file holds.
+const char SCORE_FILE_MAGIC[4] = { 'T', 'R', 'S', 'C' };
+const char SCORE_SKETCH_MAGIC[4] = { 'T', 'D', 'G', 'S' };
+const uint16_t SCORE_FILE_VERSION = 2;
+const uint32_t SCORE_FILE_BLOCK_RECORDS = 1024;
+const uint8_t SCENE_UNKNOWN = 0xFF;
+
+struct ScoreRecord {
+    int64_t timestamp;  // unix seconds; 0 for scores migrated from the text format
+    int32_t score;
+    uint32_t seed;      // rand() seed of the run
+    uint16_t level;
+    uint8_t scene;      // SceneType at the end of the run, SCENE_UNKNOWN if not known
+    uint8_t reserved[5];
+};
+static_assert(sizeof(ScoreRecord) == 24, "ScoreRecord is an on-disk format");
+
+struct ScoreFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t count;
+    uint32_t blockRecords;
+    uint32_t headerCrc;  // computed with this field zeroed
+    uint32_t reserved;
+};
+static_assert(sizeof(ScoreFileHeader) == 24, "ScoreFileHeader is an on-disk format");
+
+// Follows the records in version 2 files; the payload is ScoreSketches::encode().
+struct ScoreSketchSection {
+    char magic[4];
+    uint32_t bytes;
+    uint32_t crc;       // over the payload
+    uint32_t reserved;
+};
+static_assert(sizeof(ScoreSketchSection) == 16, "ScoreSketchSection is an on-disk format");
+
+// Slicing-by-8 CRC-32 (little-endian hosts): eight table lookups per 8 bytes,
+// fast enough to verify whole history columns when a query first touches them.
+struct Crc32Tables {
+    uint32_t t[8][256];
+    Crc32Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+        }
+    }
+};
+
+static uint32_t crc32Update(uint32_t crc, const void *data, size_t n) {
+    static const Crc32Tables tables; // thread-safe one-time init: workers checksum concurrently
+    const uint32_t (*t)[256] = tables.t;
+    const unsigned char *p = (const unsigned char*)data;
+    crc = ~crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; n > 0; --n, ++p) crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Read-only view of a whole file. mmap on POSIX; on Windows (where
+// windows.h clashes with raylib's names) the file is read into memory.
+class MappedFile {
+    const unsigned char *ptr = nullptr;
+    size_t len = 0;
+    vector<unsigned char> fallback;
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string &path) {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat sb;
+        if (fstat(fd, &sb) != 0) { ::close(fd); return false; }
+        len = (size_t)sb.st_size;
+        if (len > 0) {
+            void *m = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED) { ::close(fd); len = 0; return false; }
+            ptr = (const unsigned char*)m;
+        }
+        ::close(fd);
+        return true;
+#else
+        ifstream f(path, ios::binary);
+        if (!f.is_open()) return false;
+        fallback.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+        ptr = fallback.empty() ? nullptr : fallback.data();
+        len = fallback.size();
+        return true;
+#endif
+    }
+    void close() {
+#ifndef _WIN32
+        if (ptr) munmap((void*)ptr, len);
+#endif
+        fallback.clear();
+        ptr = nullptr;
+        len = 0;
+    }
+    const unsigned char *data() const { return ptr; }
+    size_t size() const { return len; }
+};
+
+// Zero-copy reader over a mapped score file.
+class ScoreFileView {
+    const ScoreFileHeader *hdr = nullptr;
+    const uint32_t *blockCrcs = nullptr;
+    const ScoreRecord *recs = nullptr;
+    const unsigned char *end = nullptr;
+    vector<char> verified;  // per block: 0 = unchecked, 1 = ok, 2 = bad
+
+    static uint32_t blocksFor(uint32_t count) { return (count + SCORE_FILE_BLOCK_RECORDS - 1) / SCORE_FILE_BLOCK_RECORDS; }
+    // The CRC table is padded to 8 bytes so records stay 8-byte aligned
+    static size_t tableBytes(uint32_t blocks) { return ((blocks * 4 + 7) / 8) * 8; }
+
+public:
+    static bool looksBinary(const unsigned char *data, size_t size) {
+        return size >= sizeof(ScoreFileHeader) && memcmp(data, SCORE_FILE_MAGIC, 4) == 0;
+    }
+
+    // Validates the header and CRC table; returns an error message or "".
+    string open(const unsigned char *data, size_t size) {
+        if (!looksBinary(data, size)) return "not a score file";
+        hdr = (const ScoreFileHeader*)data;
+        if (hdr->version < 1 || hdr->version > SCORE_FILE_VERSION) return "unsupported version " + to_string(hdr->version);
+        if (hdr->recordSize != sizeof(ScoreRecord) || hdr->blockRecords != SCORE_FILE_BLOCK_RECORDS) return "unexpected record layout";
+        uint32_t blocks = blocksFor(hdr->count);
+        size_t need = sizeof(ScoreFileHeader) + tableBytes(blocks) + (size_t)hdr->count * sizeof(ScoreRecord);
+        if (size < need) return "truncated";
+        ScoreFileHeader h = *hdr;
+        h.headerCrc = 0;
+        uint32_t crc = crc32Update(0, &h, sizeof(h));
+        crc = crc32Update(crc, data + sizeof(ScoreFileHeader), blocks * 4);
+        if (crc != hdr->headerCrc) return "header checksum mismatch";
+        blockCrcs = (const uint32_t*)(data + sizeof(ScoreFileHeader));
+        recs = (const ScoreRecord*)(data + sizeof(ScoreFileHeader) + tableBytes(blocks));
+        end = data + size;
+        verified.assign(blocks, 0);
+        return "";
+    }
+
+    // The sketch payload of a version 2 file; false if absent or damaged.
+    bool sketches(const unsigned char *&payload, size_t &bytes) const {
+        if (!hdr || hdr->version < 2) return false;
+        const unsigned char *p = (const unsigned char*)(recs + hdr->count);
+        if ((size_t)(end - p) < sizeof(ScoreSketchSection)) return false;
+        ScoreSketchSection sec;
+        memcpy(&sec, p, sizeof(sec));
+        p += sizeof(sec);
+        if (memcmp(sec.magic, SCORE_SKETCH_MAGIC, 4) != 0 || (size_t)(end - p) < sec.bytes) return false;
+        if (crc32Update(0, p, sec.bytes) != sec.crc) return false;
+        payload = p;
+        bytes = sec.bytes;
+        return true;
+    }
+
+    uint32_t count() const { return hdr ? hdr->count : 0; }
+
+    // Records [0, n) after verifying the blocks they live in; nullptr if corrupt.
+    const ScoreRecord *prefix(uint32_t n) {
+        n = min(n, count());
+        for (uint32_t b = 0; b * SCORE_FILE_BLOCK_RECORDS < n; ++b) {
+            if (verified[b] == 0) {
+                uint32_t first = b * SCORE_FILE_BLOCK_RECORDS;
+                uint32_t cnt = min(SCORE_FILE_BLOCK_RECORDS, count() - first);
+                verified[b] = crc32Update(0, recs + first, cnt * sizeof(ScoreRecord)) == blockCrcs[b] ? 1 : 2;
+            }
+            if (verified[b] == 2) return nullptr;
+        }
+        return recs;
+    }
+
+    static string serialize(const vector<ScoreRecord> &records, const string &sketchPayload = string()) {
+        ScoreFileHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SCORE_FILE_MAGIC, 4);
+        h.version = SCORE_FILE_VERSION;
+        h.recordSize = sizeof(ScoreRecord);
+        h.count = (uint32_t)records.size();
+        h.blockRecords = SCORE_FILE_BLOCK_RECORDS;
+        uint32_t blocks = blocksFor(h.count);
+        vector<uint32_t> table(tableBytes(blocks) / 4, 0);
+        for (uint32_t b = 0; b < blocks; ++b) {
+            uint32_t first = b * SCORE_FILE_BLOCK_RECORDS;
+            uint32_t cnt = min(SCORE_FILE_BLOCK_RECORDS, h.count - first);
+            table[b] = crc32Update(0, records.data() + first, cnt * sizeof(ScoreRecord));
+        }
+        uint32_t crc = crc32Update(0, &h, sizeof(h));
+        h.headerCrc = crc32Update(crc, table.data(), blocks * 4);
+        string out;
+        out.append((const char*)&h, sizeof(h));
+        out.append((const char*)table.data(), table.size() * 4);
+        out.append((const char*)records.data(), records.size() * sizeof(ScoreRecord));
+        ScoreSketchSection sec;
+        memset(&sec, 0, sizeof(sec));
+        memcpy(sec.magic, SCORE_SKETCH_MAGIC, 4);
+        sec.bytes = (uint32_t)sketchPayload.size();
+        sec.crc = crc32Update(0, sketchPayload.data(), sketchPayload.size());
+        out.append((const char*)&sec, sizeof(sec));
+        out += sketchPayload;
+        return out;
+    }
+};
+
+struct RunInfo {
+    int64_t timestamp;
+    int level;
+    SceneType scene;
+    uint32_t seed;
+    uint32_t frames;    // frames survived
+};
+
+// Where a finished run stands against every run before it.
+struct RunStanding {
+    uint32_t rank = 0;              // exact, from the leaderboard
+    float scoreBeaten = 0;          // % of runs with a lower score (sketch)
+    float survivalBeaten = 0;       // % of runs at the same level that survived less (sketch)
+    float levelMedianSec = 0, levelP90Sec = 0;
+    uint32_t levelRuns = 0;
+};
+
+// -------------------- Run History --------------------
+// Every finished run is appended to traffic_runs.log as a fixed 48-byte
+// record (O(1), on the history job stream). Once the log holds
+// RUN_LOG_COMPACT_ROWS records it is rotated out and a background job turns
+// it into an immutable columnar segment; segments are merged 8 at a time
+// into larger tiers so a soak box with millions of runs keeps a small
+// number of files.
+const uint32_t RUN_LOG_COMPACT_ROWS = 4096;
+const uint32_t RUN_SEGMENT_MERGE_FANOUT = 8;
+const uint32_t RUN_ZONE_ROWS = 4096;       // rows per min/max zone-map block
+const char RUN_SEGMENT_MAGIC[4] = { 'T', 'R', 'S', 'G' };
+const uint16_t RUN_SEGMENT_VERSION = 1;
+
+// Identifies the binary a run was played on; override with -DBUILD_ID=...
+#ifndef BUILD_ID
+#define BUILD_ID crc32Update(0, __DATE__ " " __TIME__, sizeof(__DATE__ " " __TIME__) - 1)
+#endif
+
+struct RunRecord {
+    int64_t timestamp;      // unix seconds at the end of the run
+    int32_t score;
+    int32_t maxStreak;
+    uint32_t frames;        // frames survived
+    uint32_t seed;
+    uint32_t build;
+    uint16_t level;         // level reached
+    uint16_t collisions;    // car hits, shielded or not
+    uint8_t scenes;         // bitmask of SceneTypes visited
+    uint8_t finalScene;
+    uint8_t reserved[10];
+    uint32_t crc;           // over the bytes above; detects a torn tail in the log
+};
+static_assert(sizeof(RunRecord) == 48, "RunRecord is an on-disk format");
+
+static void sealRunRecord(RunRecord &r) { r.crc = crc32Update(0, &r, offsetof(RunRecord, crc)); }
+static bool runRecordValid(const RunRecord &r) { return r.crc == crc32Update(0, &r, offsetof(RunRecord, crc)); }
+
+enum RunColumn {
+    COL_TIMESTAMP, COL_SCORE, COL_MAX_STREAK, COL_FRAMES, COL_SEED, COL_BUILD,
+    COL_LEVEL, COL_COLLISIONS, COL_SCENES, COL_FINAL_SCENE,
+    COL_SCORE_ORDER,   // index: row ids sorted by score, best first
+    COL_ZONES,         // index: per data column, min/max per RUN_ZONE_ROWS block
+    COL_COUNT
+};
+const int RUN_DATA_COLUMNS = COL_SCORE_ORDER;
+static const uint8_t RUN_COLUMN_WIDTH[COL_COUNT] = { 8, 4, 4, 4, 4, 4, 2, 2, 1, 1, 4, 8 };
+
+struct RunSegmentHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t columns;
+    uint32_t rows;
+    uint32_t firstId, lastId;   // log ids this segment covers (a range after merges)
+    uint32_t zoneRows;
+    uint32_t dirCrc;            // over the column directory
+    uint32_t reserved;
+};
+static_assert(sizeof(RunSegmentHeader) == 32, "RunSegmentHeader is an on-disk format");
+
+struct RunColumnEntry {
+    uint64_t offset, bytes;
+    uint32_t crc;               // over the column's bytes; checked on first access
+    uint16_t id;
+    uint8_t width;
+    uint8_t reserved;
+};
+static_assert(sizeof(RunColumnEntry) == 24, "RunColumnEntry is an on-disk format");
+
+static int64_t runColumnValue(const RunRecord &r, int col) {
+    switch (col) {
+        case COL_TIMESTAMP: return r.timestamp;
+        case COL_SCORE: return r.score;
+        case COL_MAX_STREAK: return r.maxStreak;
+        case COL_FRAMES: return r.frames;
+        case COL_SEED: return r.seed;
+        case COL_BUILD: return r.build;
+        case COL_LEVEL: return r.level;
+        case COL_COLLISIONS: return r.collisions;
+        case COL_SCENES: return r.scenes;
+        case COL_FINAL_SCENE: return r.finalScene;
+        default: return 0;
+    }
+}
+
+// Read-only, memory-mapped columnar segment.
+class RunSegment {
+    MappedFile file;
+    const RunSegmentHeader *hdr = nullptr;
+    const RunColumnEntry *dir = nullptr;
+    vector<char> verified;  // per column: 0 = unchecked, 1 = ok, 2 = bad
+
+public:
+    // Returns an error message, or "" once the header and directory check out.
+    string open(const string &path) {
+        if (!file.open(path)) return "cannot open " + path;
+        if (file.size() < sizeof(RunSegmentHeader) || memcmp(file.data(), RUN_SEGMENT_MAGIC, 4) != 0) return "not a run segment";
+        hdr = (const RunSegmentHeader*)file.data();
+        if (hdr->version != RUN_SEGMENT_VERSION || hdr->columns != COL_COUNT) return "unsupported segment version";
+        size_t dirBytes = sizeof(RunColumnEntry) * COL_COUNT;
+        if (file.size() < sizeof(RunSegmentHeader) + dirBytes) return "truncated";
+        dir = (const RunColumnEntry*)(file.data() + sizeof(RunSegmentHeader));
+        if (crc32Update(0, dir, dirBytes) != hdr->dirCrc) return "directory checksum mismatch";
+        for (int c = 0; c < COL_COUNT; ++c) {
+            if (dir[c].offset + dir[c].bytes > file.size() || dir[c].width != RUN_COLUMN_WIDTH[c]) return "bad column directory";
+        }
+        verified.assign(COL_COUNT, 0);
+        return "";
+    }
+    uint32_t rows() const { return hdr ? hdr->rows : 0; }
+    uint32_t firstId() const { return hdr->firstId; }
+    uint32_t lastId() const { return hdr->lastId; }
+
+    // Zero-copy column access; nullptr if the column fails its checksum.
+    template <typename T>
+    const T *column(int col) {
+        if (verified[col] == 0) {
+            const RunColumnEntry &e = dir[col];
+            verified[col] = crc32Update(0, file.data() + e.offset, (size_t)e.bytes) == e.crc ? 1 : 2;
+        }
+        return verified[col] == 1 ? (const T*)(file.data() + dir[col].offset) : nullptr;
+    }
+    int64_t value(int col, uint32_t row) {
+        switch (RUN_COLUMN_WIDTH[col]) {
+            case 8: return column<int64_t>(col)[row];
+            case 4: return col == COL_SCORE || col == COL_MAX_STREAK ? column<int32_t>(col)[row] : column<uint32_t>(col)[row];
+            case 2: return column<uint16_t>(col)[row];
+            default: return column<uint8_t>(col)[row];
+        }
+    }
+    // Zone map for a data column: {min, max} of rows [b*zoneRows, (b+1)*zoneRows)
+    const int64_t *zone(int col, uint32_t block) {
+        const int64_t *z = column<int64_t>(COL_ZONES);
+        uint32_t blocks = (rows() + hdr->zoneRows - 1) / hdr->zoneRows;
+        return z ? z + ((size_t)col * blocks + block) * 2 : nullptr;
+    }
+    uint32_t zoneRows() const { return hdr->zoneRows; }
+    bool verifyAll() {
+        for (int c = 0; c < COL_COUNT; ++c) if (!column<char>(c)) return false;
+        return true;
+    }
+    RunRecord record(uint32_t row) {
+        RunRecord r;
+        memset(&r, 0, sizeof(r));
+        r.timestamp = value(COL_TIMESTAMP, row);
+        r.score = (int32_t)value(COL_SCORE, row);
+        r.maxStreak = (int32_t)value(COL_MAX_STREAK, row);
+        r.frames = (uint32_t)value(COL_FRAMES, row);
+        r.seed = (uint32_t)value(COL_SEED, row);
+        r.build = (uint32_t)value(COL_BUILD, row);
+        r.level = (uint16_t)value(COL_LEVEL, row);
+        r.collisions = (uint16_t)value(COL_COLLISIONS, row);
+        r.scenes = (uint8_t)value(COL_SCENES, row);
+        r.finalScene = (uint8_t)value(COL_FINAL_SCENE, row);
+        sealRunRecord(r);
+        return r;
+    }
+
+    static string build(const vector<RunRecord> &rows, uint32_t firstId, uint32_t lastId) {
+        uint32_t n = (uint32_t)rows.size();
+        uint32_t blocks = (n + RUN_ZONE_ROWS - 1) / RUN_ZONE_ROWS;
+        vector<string> cols(COL_COUNT);
+        for (int c = 0; c < RUN_DATA_COLUMNS; ++c) {
+            string &out = cols[c];
+            out.resize((size_t)n * RUN_COLUMN_WIDTH[c]);
+            for (uint32_t i = 0; i < n; ++i) {
+                int64_t v = runColumnValue(rows[i], c);
+                memcpy(&out[(size_t)i * RUN_COLUMN_WIDTH[c]], &v, RUN_COLUMN_WIDTH[c]); // little-endian truncation
+            }
+        }
+        vector<uint32_t> order(n);
+        for (uint32_t i = 0; i < n; ++i) order[i] = i;
+        stable_sort(order.begin(), order.end(), [&rows](uint32_t a, uint32_t b) { return rows[a].score > rows[b].score; });
+        cols[COL_SCORE_ORDER].assign((const char*)order.data(), order.size() * 4);
+        vector<int64_t> zones((size_t)RUN_DATA_COLUMNS * blocks * 2);
+        for (int c = 0; c < RUN_DATA_COLUMNS; ++c) {
+            for (uint32_t b = 0; b < blocks; ++b) {
+                int64_t lo = INT64_MAX, hi = INT64_MIN;
+                for (uint32_t i = b * RUN_ZONE_ROWS; i < min(n, (b + 1) * RUN_ZONE_ROWS); ++i) {
+                    int64_t v = runColumnValue(rows[i], c);
+                    lo = min(lo, v); hi = max(hi, v);
+                }
+                zones[((size_t)c * blocks + b) * 2] = lo;
+                zones[((size_t)c * blocks + b) * 2 + 1] = hi;
+            }
+        }
+        cols[COL_ZONES].assign((const char*)zones.data(), zones.size() * 8);
+
+        RunSegmentHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, RUN_SEGMENT_MAGIC, 4);
+        h.version = RUN_SEGMENT_VERSION;
+        h.columns = COL_COUNT;
+        h.rows = n;
+        h.firstId = firstId; h.lastId = lastId;
+        h.zoneRows = RUN_ZONE_ROWS;
+        RunColumnEntry dirEntries[COL_COUNT];
+        uint64_t offset = sizeof(RunSegmentHeader) + sizeof(dirEntries);
+        for (int c = 0; c < COL_COUNT; ++c) {
+            offset = (offset + 7) & ~(uint64_t)7; // keep every column 8-byte aligned
+            memset(&dirEntries[c], 0, sizeof(RunColumnEntry));
+            dirEntries[c].offset = offset;
+            dirEntries[c].bytes = cols[c].size();
+            dirEntries[c].crc = crc32Update(0, cols[c].data(), cols[c].size());
+            dirEntries[c].id = (uint16_t)c;
+            dirEntries[c].width = RUN_COLUMN_WIDTH[c];
+            offset += cols[c].size();
+        }
+        h.dirCrc = crc32Update(0, dirEntries, sizeof(dirEntries));
+        string out((const char*)&h, sizeof(h));
+        out.append((const char*)dirEntries, sizeof(dirEntries));
+        for (int c = 0; c < COL_COUNT; ++c) {
+            out.resize((out.size() + 7) & ~(size_t)7, '\0');
+            out += cols[c];
+        }
+        return out;
+    }
+};
+
+class RunHistory {
+    struct SegmentName { uint32_t first, last; };
+    struct State {
+        string base;            // e.g. "traffic_runs" -> traffic_runs.log, traffic_runs.1-8.seg
+        mutex filesMtx;         // held while files are renamed/removed and while readers list+open them
+        FILE *log = nullptr;
+        uint32_t logRows = 0;
+        uint32_t nextId = 1;    // id the active log gets when rotated
+        atomic<uint64_t> appended{0};
+        ~State() { if (log) fclose(log); }
+
+        string logPath() const { return base + ".log"; }
+        string compactingPath(uint32_t id) const { return base + "." + to_string(id) + ".compacting"; }
+        string segmentPath(uint32_t first, uint32_t last) const { return base + "." + to_string(first) + "-" + to_string(last) + ".seg"; }
+    };
+    shared_ptr<State> st;
+    JobQueue *jobs = nullptr;
+
+    static bool parseName(const string &file, const string &prefix, const string &suffix, SegmentName &out) {
+        if (file.size() <= prefix.size() + suffix.size() || file.compare(0, prefix.size(), prefix) != 0 ||
+            file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0) return false;
+        string mid = file.substr(prefix.size(), file.size() - prefix.size() - suffix.size());
+        unsigned a = 0, b = 0;
+        if (sscanf(mid.c_str(), "%u-%u", &a, &b) == 2) { out.first = a; out.last = b; return true; }
+        if (sscanf(mid.c_str(), "%u", &a) == 1) { out.first = out.last = a; return true; }
+        return false;
+    }
+
+    // Live segments, oldest first. Segments whose range is covered by a
+    // merged segment (a merge interrupted before its cleanup) are ignored.
+    static vector<SegmentName> listSegments(State &s) {
+        vector<SegmentName> all;
+        filesystem::path base(s.base);
+        string dir = base.parent_path().string();
+        string prefix = base.filename().string() + ".";
+        error_code ec;
+        for (auto &e : filesystem::directory_iterator(dir.empty() ? "." : dir, ec)) {
+            SegmentName n;
+            if (parseName(e.path().filename().string(), prefix, ".seg", n)) all.push_back(n);
+        }
+        vector<SegmentName> live;
+        for (auto &a : all) {
+            bool covered = false;
+            for (auto &b : all) {
+                if ((b.first != a.first || b.last != a.last) && b.first <= a.first && a.last <= b.last) { covered = true; break; }
+            }
+            if (!covered) live.push_back(a);
+        }
+        sort(live.begin(), live.end(), [](const SegmentName &a, const SegmentName &b) { return a.first < b.first; });
+        return live;
+    }
+    static vector<uint32_t> listCompacting(State &s) {
+        vector<uint32_t> ids;
+        filesystem::path base(s.base);
+        string dir = base.parent_path().string();
+        string prefix = base.filename().string() + ".";
+        error_code ec;
+        for (auto &e : filesystem::directory_iterator(dir.empty() ? "." : dir, ec)) {
+            SegmentName n;
+            if (parseName(e.path().filename().string(), prefix, ".compacting", n)) ids.push_back(n.first);
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+    static bool covered(const vector<SegmentName> &segs, uint32_t id) {
+        for (auto &g : segs) if (g.first <= id && id <= g.last) return true;
+        return false;
+    }
+
+    // Valid records of a log file; stops at the first torn/corrupt record.
+    static vector<RunRecord> readLog(const string &path) {
+        vector<RunRecord> out;
+        MappedFile f;
+        if (!f.open(path)) return out;
+        size_t n = f.size() / sizeof(RunRecord);
+        const RunRecord *recs = (const RunRecord*)f.data();
+        out.reserve(n);
+        for (size_t i = 0; i < n && runRecordValid(recs[i]); ++i) out.push_back(recs[i]);
+        return out;
+    }
+
+    static void compact(shared_ptr<State> s, uint32_t id) {
+        string src = s->compactingPath(id);
+        vector<RunRecord> rows = readLog(src);
+        writeFileDurably(s->segmentPath(id, id) + ".tmp", RunSegment::build(rows, id, id));
+        {
+            lock_guard<mutex> lk(s->filesMtx);
+            error_code ec;
+            filesystem::rename(s->segmentPath(id, id) + ".tmp", s->segmentPath(id, id), ec);
+            if (ec) throw runtime_error("cannot publish run segment: " + ec.message());
+            syncParentDir(s->base);
+            remove(src.c_str());
+        }
+        mergeTiers(s);
+    }
+
+    static int tierOf(const SegmentName &n) {
+        int t = 0;
+        for (uint32_t span = n.last - n.first + 1; span >= RUN_SEGMENT_MERGE_FANOUT; span /= RUN_SEGMENT_MERGE_FANOUT) t++;
+        return t;
+    }
+
+    // Merges the oldest FANOUT segments of any tier that has filled up.
+    static void mergeTiers(shared_ptr<State> s) {
+        while (true) {
+            vector<SegmentName> segs;
+            {
+                lock_guard<mutex> lk(s->filesMtx);
+                segs = listSegments(*s);
+            }
+            vector<SegmentName> batch;
+            for (size_t i = 0; i < segs.size() && batch.size() < RUN_SEGMENT_MERGE_FANOUT; ++i) {
+                if (!batch.empty() && (tierOf(segs[i]) != tierOf(batch[0]) || segs[i].first != batch.back().last + 1)) batch.clear();
+                batch.push_back(segs[i]);
+            }
+            if (batch.size() < RUN_SEGMENT_MERGE_FANOUT) return;
+
+            vector<RunRecord> rows;
+            for (auto &g : batch) {
+                RunSegment seg;
+                if (!seg.open(s->segmentPath(g.first, g.last)).empty() || !seg.verifyAll()) {
+                    TraceLog(LOG_WARNING, "HISTORY: Skipping merge, segment %u-%u unreadable", g.first, g.last);
+                    return;
+                }
+                for (uint32_t r = 0; r < seg.rows(); ++r) rows.push_back(seg.record(r));
+            }
+            uint32_t first = batch.front().first, last = batch.back().last;
+            string path = s->segmentPath(first, last);
+            writeFileDurably(path + ".tmp", RunSegment::build(rows, first, last));
+            lock_guard<mutex> lk(s->filesMtx);
+            error_code ec;
+            filesystem::rename(path + ".tmp", path, ec);
+            if (ec) throw runtime_error("cannot publish merged segment: " + ec.message());
+            syncParentDir(s->base);
+            for (auto &g : batch) remove(s->segmentPath(g.first, g.last).c_str());
+        }
+    }
+
+    static void appendNow(shared_ptr<State> s, JobQueue *jobs, const RunRecord &r) {
+        uint32_t rotated = 0;
+        {
+            lock_guard<mutex> lk(s->filesMtx);
+            if (!s->log) s->log = fopen(s->logPath().c_str(), "ab");
+            if (!s->log) throw runtime_error("cannot open " + s->logPath());
+            if (fwrite(&r, sizeof(r), 1, s->log) != 1 || fflush(s->log) != 0) throw runtime_error("failed appending to " + s->logPath());
+            s->logRows++;
+            s->appended++;
+            if (s->logRows >= RUN_LOG_COMPACT_ROWS) {
+                syncFile(s->log);
+                fclose(s->log);
+                s->log = nullptr;
+                rotated = s->nextId++;
+                error_code ec;
+                filesystem::rename(s->logPath(), s->compactingPath(rotated), ec);
+                if (ec) { s->nextId--; rotated = 0; TraceLog(LOG_WARNING, "HISTORY: Log rotation failed: %s", ec.message().c_str()); }
+                else s->logRows = 0;
+            }
+        }
+        if (rotated) jobs->push(JOB_STREAM_COMPACTION, [s, rotated]() { compact(s, rotated); });
+    }
+
+    // Recovers from an interrupted rotation/compaction/merge and queues any
+    // outstanding compactions: lists the directory and scans the active log
+    // (at most RUN_LOG_COMPACT_ROWS records) to find its valid length.
+    static void recover(shared_ptr<State> st, JobQueue *jobs) {
+        vector<uint32_t> pending;
+        {
+            lock_guard<mutex> lk(st->filesMtx);
+            vector<SegmentName> segs = listSegments(*st);
+            uint32_t maxId = 0;
+            for (auto &g : segs) maxId = max(maxId, g.last);
+            for (uint32_t id : listCompacting(*st)) {
+                maxId = max(maxId, id);
+                if (covered(segs, id)) remove(st->compactingPath(id).c_str());
+                else pending.push_back(id);
+            }
+            st->nextId = maxId + 1;
+            vector<RunRecord> tail = readLog(st->logPath());
+            st->logRows = (uint32_t)tail.size();
+            error_code ec;
+            if (filesystem::exists(st->logPath(), ec) &&
+                filesystem::file_size(st->logPath(), ec) != tail.size() * sizeof(RunRecord)) {
+                filesystem::resize_file(st->logPath(), tail.size() * sizeof(RunRecord), ec); // drop a torn tail
+            }
+        }
+        for (uint32_t id : pending) jobs->push(JOB_STREAM_COMPACTION, [st, id]() { compact(st, id); });
+        if (pending.empty()) jobs->push(JOB_STREAM_COMPACTION, [st]() { mergeTiers(st); });
+    }
+
 public:
-    PowerUp(float x, float y, PowerUpType t) : pos(x,y), type(t), rot(0), pulse(0), collected(false) {
-        switch(t) { case SHIELD: color = SKYBLUE; break; case SLOW_MOTION: color = PURPLE; break; case SCORE_MULTIPLIER: color = GOLD; break; case EXTRA_LIFE: color = RED; break; }
+    explicit RunHistory(const string &base = "traffic_runs"): st(make_shared<State>()) { st->base = base; }
+
+    // Returns at once: recovery runs first on the history stream, so appends
+    // (and anything else queued there) always see a recovered log.
+    void open(JobQueue &jobQueue) {
+        jobs = &jobQueue;
+        shared_ptr<State> s = st;
+        JobQueue *q = jobs;
+        jobQueue.push(JOB_STREAM_HISTORY, [s, q]() { recover(s, q); });
     }
-    void update() { pos.y += 2.5f; rot += 3.0f; pulse += 0.08f; }
-    void draw() const {
-        if (collected) return;
-        float psize = 30 + sin(pulse) * 5;
-        DrawCircle(pos.x, pos.y, psize + 10, Fade(color, 0.2f));
-        DrawCircle(pos.x, pos.y, psize + 5, Fade(color, 0.3f));
-        DrawCircle(pos.x, pos.y, psize, Fade(color, 0.4f));
-        Rectangle r = { pos.x - 17.5f, pos.y - 17.5f, 35, 35 };
-        DrawRectanglePro(r, (Vector2){17.5f,17.5f}, rot, color);
-        Rectangle i = { pos.x - 12.5f, pos.y - 12.5f, 25, 25 };
-        DrawRectanglePro(i, (Vector2){12.5f,12.5f}, -rot*1.5f, Fade(WHITE, 0.5f));
-        const char* s = "";
-        switch(type) { case SHIELD: s="S"; break; case SLOW_MOTION: s="T"; break; case SCORE_MULTIPLIER: s="X"; break; case EXTRA_LIFE: s="H"; break; }
-        DrawText(s, pos.x - 8, pos.y - 12, 25, WHITE);
+
+    // O(1) on the calling thread: the write happens on the history stream.
+    void append(RunRecord r) {
+        sealRunRecord(r);
+        shared_ptr<State> s = st;
+        JobQueue *q = jobs;
+        if (!q) return;
+        q->push(JOB_STREAM_HISTORY, [s, q, r]() { appendNow(s, q, r); });
+    }
+
+    uint64_t appendedThisSession() const { return st->appended.load(); }
+
+    // Consistent view of the history: mapped segments plus the runs not yet
+    // compacted (rotated logs, then the active log). Safe while appends continue.
+    void snapshot(vector<unique_ptr<RunSegment>> &segments, vector<RunRecord> &tail) const {
+        lock_guard<mutex> lk(st->filesMtx);
+        vector<SegmentName> segs = listSegments(*st);
+        for (auto &g : segs) {
+            unique_ptr<RunSegment> seg(new RunSegment());
+            string err = seg->open(st->segmentPath(g.first, g.last));
+            if (err.empty()) segments.push_back(move(seg));
+            else TraceLog(LOG_WARNING, "HISTORY: Segment %u-%u skipped: %s", g.first, g.last, err.c_str());
+        }
+        for (uint32_t id : listCompacting(*st)) {
+            if (covered(segs, id)) continue;
+            vector<RunRecord> l = readLog(st->compactingPath(id));
+            tail.insert(tail.end(), l.begin(), l.end());
+        }
+        vector<RunRecord> l = readLog(st->logPath());
+        tail.insert(tail.end(), l.begin(), l.end());
+    }
+
+    // Visits every recorded run, oldest segments first.
+    template <typename F>
+    void forEachRun(F fn) const {
+        vector<unique_ptr<RunSegment>> segments;
+        vector<RunRecord> tail;
+        snapshot(segments, tail);
+        for (auto &seg : segments) {
+            if (!seg->verifyAll()) continue;
+            for (uint32_t r = 0; r < seg->rows(); ++r) fn(seg->record(r));
+        }
+        for (auto &r : tail) fn(r);
     }
-    CollisionBox box() const { return { pos.x - 20, pos.y - 20, 40, 40 }; }
-    Position getPos() const { return pos; }
-    PowerUpType getType() const { return type; }
-    bool isCollected() const { return collected; }
-    void setCollected(bool v) { collected = v; }
-    void setPos(float x, float y) { pos.x = x; pos.y = y; }
 };
 
-// -------------------- ActivePowerUp --------------------
-struct ActivePowerUp { PowerUpType type; float timeRemaining; ActivePowerUp(PowerUpType t, float tm): type(t), timeRemaining(tm) {} };
+// -------------------- Quantile Sketch (t-digest) --------------------
+// Merging t-digest with fixed storage: values land in a small buffer that is
+// folded into at most SKETCH_CENTROIDS centroids (the k1 scale function keeps
+// the tails precise). Memory does not grow with the number of values, and two
+// sketches merge by folding one's centroids into the other.
+const int SKETCH_CENTROIDS = 128;
+const int SKETCH_BUFFER = 64;
+const double SKETCH_COMPRESSION = 100.0;    // at most ~compression centroids survive a fold
 
-// -------------------- Thread-safe Job Queue --------------------
-class JobQueue {
-    vector<function<void()>> jobs;
-    mutex mtx;
-    condition_variable cv;
-    thread worker;
-    atomic<bool> running;
+class QuantileSketch {
 public:
-    JobQueue(): running(true) {
-        worker = thread([this]{
-            while (running) {
-                function<void()> job;
-                {
-                    unique_lock<mutex> lk(mtx);
-                    cv.wait(lk, [this]{ return !jobs.empty() || !running; });
-                    if (!running && jobs.empty()) break;
-                    job = move(jobs.back());
-                    jobs.pop_back();
-                }
-                try {
-                    if (job) job();
-                } catch (...) { /* swallow exceptions inside worker */ }
+    struct Centroid { double mean, weight; };
+private:
+    // Folding the buffer in doesn't change what the sketch represents, so
+    // const queries may do it.
+    mutable Centroid centroids[SKETCH_CENTROIDS];
+    mutable Centroid buffer[SKETCH_BUFFER];
+    mutable int used = 0, buffered = 0;
+    double total = 0, lo = 0, hi = 0;
+
+    static double scale(double q) { return SKETCH_COMPRESSION / (2.0 * (double)PI) * asin(2.0 * q - 1.0); }
+
+    void compress() const {
+        if (buffered == 0) return;
+        Centroid all[SKETCH_CENTROIDS + SKETCH_BUFFER];
+        int n = 0;
+        for (int i = 0; i < used; ++i) all[n++] = centroids[i];
+        for (int i = 0; i < buffered; ++i) all[n++] = buffer[i];
+        buffered = 0;
+        if (n == 0) return;
+        sort(all, all + n, [](const Centroid &a, const Centroid &b) { return a.mean < b.mean; });
+        double before = 0;
+        Centroid cur = all[0];
+        used = 0;
+        for (int i = 1; i < n; ++i) {
+            double q0 = before / total, q1 = (before + cur.weight + all[i].weight) / total;
+            if (scale(min(q1, 1.0)) - scale(q0) <= 1.0 || used == SKETCH_CENTROIDS - 1) {
+                cur.mean += (all[i].mean - cur.mean) * all[i].weight / (cur.weight + all[i].weight);
+                cur.weight += all[i].weight;
+            } else {
+                before += cur.weight;
+                centroids[used++] = cur;
+                cur = all[i];
             }
-        });
+        }
+        centroids[used++] = cur;
     }
-    ~JobQueue() {
-        shutdown();
+    void addCentroid(double mean, double weight) {
+        if (buffered == SKETCH_BUFFER) compress();
+        if (total == 0) { lo = hi = mean; }
+        lo = min(lo, mean); hi = max(hi, mean);
+        buffer[buffered++] = Centroid{ mean, weight };
+        total += weight;
     }
-    void push(function<void()> job) {
-        {
-            lock_guard<mutex> lk(mtx);
-            jobs.push_back(move(job));
+
+public:
+    void add(double x) { addCentroid(x, 1.0); }
+    void clear() { used = buffered = 0; total = lo = hi = 0; }
+    void merge(const QuantileSketch &other) {
+        other.compress();
+        double olo = other.lo, ohi = other.hi;
+        for (int i = 0; i < other.used; ++i) addCentroid(other.centroids[i].mean, other.centroids[i].weight);
+        if (other.total > 0) { lo = min(lo, olo); hi = max(hi, ohi); }
+    }
+    double count() const { return total; }
+    bool empty() const { return total == 0; }
+
+    // Fraction of values <= x, interpolating between centroid centres.
+    double cdf(double x) const {
+        compress();
+        if (total == 0) return 0;
+        if (x < lo) return 0;
+        if (x >= hi) return 1;
+        double cum = 0;
+        for (int i = 0; i < used; ++i) {
+            const Centroid &c = centroids[i];
+            double left = i == 0 ? lo : (centroids[i - 1].mean + c.mean) / 2;
+            double right = i == used - 1 ? hi : (c.mean + centroids[i + 1].mean) / 2;
+            if (x < right) {
+                double span = right - left;
+                double frac = span > 0 ? (x - left) / span : 1.0;
+                return (cum + c.weight * frac) / total;
+            }
+            cum += c.weight;
         }
-        cv.notify_one();
+        return 1;
     }
-    void shutdown() {
-        if (running.exchange(false)) {
-            cv.notify_all();
-            if (worker.joinable()) worker.join();
+    // Value below which a fraction q of the values fall.
+    double quantile(double q) const {
+        compress();
+        if (total == 0) return 0;
+        q = min(max(q, 0.0), 1.0);
+        double target = q * total, cum = 0;
+        for (int i = 0; i < used; ++i) {
+            const Centroid &c = centroids[i];
+            if (target <= cum + c.weight) {
+                double left = i == 0 ? lo : (centroids[i - 1].mean + c.mean) / 2;
+                double right = i == used - 1 ? hi : (c.mean + centroids[i + 1].mean) / 2;
+                return left + (right - left) * (target - cum) / c.weight;
+            }
+            cum += c.weight;
         }
+        return hi;
+    }
+
+    // Serialized form: total, min, max, centroid count, then the centroids.
+    void encode(string &out) const {
+        compress();
+        uint32_t n = (uint32_t)used;
+        out.append((const char*)&total, sizeof(total));
+        out.append((const char*)&lo, sizeof(lo));
+        out.append((const char*)&hi, sizeof(hi));
+        out.append((const char*)&n, sizeof(n));
+        out.append((const char*)centroids, n * sizeof(Centroid));
+    }
+    // Returns bytes consumed, or 0 if the input is malformed.
+    size_t decode(const unsigned char *p, size_t size) {
+        const size_t head = 3 * sizeof(double) + sizeof(uint32_t);
+        if (size < head) return 0;
+        uint32_t n;
+        memcpy(&total, p, 8); memcpy(&lo, p + 8, 8); memcpy(&hi, p + 16, 8); memcpy(&n, p + 24, 4);
+        if (n > SKETCH_CENTROIDS || size < head + n * sizeof(Centroid)) { clear(); return 0; }
+        memcpy(centroids, p + head, n * sizeof(Centroid));
+        used = (int)n;
+        buffered = 0;
+        return head + n * sizeof(Centroid);
     }
 };
 
-// -------------------- Event Scheduler --------------------
-struct Event {
-    uint64_t tick;
-    function<void()> action;
-    bool operator>(const Event &o) const { return tick > o.tick; }
+// The score file's sketch section: score distribution over all runs plus
+// survival time (frames) per level reached.
+struct ScoreSketches {
+    QuantileSketch scores;
+    QuantileSketch survival[MAX_LEVEL + 1];
+
+    void add(int32_t score, int level, uint32_t frames) {
+        scores.add(score);
+        survival[min(max(level, 0), MAX_LEVEL)].add(frames);
+    }
+    void merge(const ScoreSketches &o) {
+        scores.merge(o.scores);
+        for (int l = 0; l <= MAX_LEVEL; ++l) survival[l].merge(o.survival[l]);
+    }
+    // uint16 id (0xFFFF = scores, else level) + sketch, for non-empty sketches only
+    string encode() const {
+        string out;
+        auto put = [&out](uint16_t id, const QuantileSketch &s) {
+            if (s.empty()) return;
+            out.append((const char*)&id, sizeof(id));
+            s.encode(out);
+        };
+        put(0xFFFF, scores);
+        for (int l = 0; l <= MAX_LEVEL; ++l) put((uint16_t)l, survival[l]);
+        return out;
+    }
+    void clear() {
+        scores.clear();
+        for (auto &s : survival) s.clear();
+    }
+    bool decode(const unsigned char *p, size_t size) {
+        clear();
+        while (size > 0) {
+            uint16_t id;
+            if (size < sizeof(id)) return false;
+            memcpy(&id, p, sizeof(id));
+            p += sizeof(id); size -= sizeof(id);
+            if (id != 0xFFFF && id > MAX_LEVEL) return false;
+            size_t used = (id == 0xFFFF ? scores : survival[id]).decode(p, size);
+            if (used == 0) return false;
+            p += used; size -= used;
+        }
+        return true;
+    }
 };
-class EventScheduler {
-    priority_queue<Event, vector<Event>, greater<Event>> pq;
-    mutex mtx;
+
+// -------------------- Leaderboard (order statistics) --------------------
+// Treap keyed best-first (score desc, then oldest, then seed) and
+// augmented with subtree sizes, so rank, k-th and top-N are O(log n).
+// Nodes live in one vector and refer to records by index.
+class OrderStatTree {
+    struct Node { uint32_t rec, left, right, size; int32_t score; };  // score copied in to keep descents in-node
+    const vector<ScoreRecord> *recs;
+    vector<Node> nodes;     // nodes[0] is the null sentinel (size 0)
+    uint32_t root = 0;
+
+    static uint32_t priority(uint32_t rec) {
+        uint32_t h = rec * 0x9E3779B1u;
+        h ^= h >> 16; h *= 0x85EBCA6Bu; h ^= h >> 13;
+        return h;
+    }
+    static bool better(const ScoreRecord &x, const ScoreRecord &y) {
+        if (x.score != y.score) return x.score > y.score;
+        if (x.timestamp != y.timestamp) return x.timestamp < y.timestamp;
+        return x.seed < y.seed;
+    }
+    bool before(const Node &a, const Node &b) const {
+        if (a.score != b.score) return a.score > b.score;
+        const ScoreRecord &x = (*recs)[a.rec], &y = (*recs)[b.rec];
+        if (better(x, y)) return true;
+        return !better(y, x) && a.rec < b.rec;
+    }
+    void pull(uint32_t n) { nodes[n].size = 1 + nodes[nodes[n].left].size + nodes[nodes[n].right].size; }
+    // Splits t into nodes ordered before node n (a) and the rest (b).
+    void split(uint32_t t, uint32_t n, uint32_t &a, uint32_t &b) {
+        if (!t) { a = b = 0; return; }
+        if (before(nodes[t], nodes[n])) { split(nodes[t].right, n, nodes[t].right, b); a = t; }
+        else { split(nodes[t].left, n, a, nodes[t].left); b = t; }
+        pull(t);
+    }
+    uint32_t insertAt(uint32_t t, uint32_t n) {
+        if (!t) return n;
+        if (priority(nodes[n].rec) > priority(nodes[t].rec)) {
+            split(t, n, nodes[n].left, nodes[n].right);
+            pull(n);
+            return n;
+        }
+        if (before(nodes[n], nodes[t])) nodes[t].left = insertAt(nodes[t].left, n);
+        else nodes[t].right = insertAt(nodes[t].right, n);
+        pull(t);
+        return t;
+    }
 public:
-    void scheduleAt(uint64_t tick, function<void()> action) {
-        lock_guard<mutex> lk(mtx);
-        pq.push(Event{tick, action});
+    explicit OrderStatTree(const vector<ScoreRecord> *records): recs(records), nodes(1, Node{0, 0, 0, 0, 0}) {}
+    void insert(uint32_t rec) {
+        nodes.push_back(Node{rec, 0, 0, 1, (*recs)[rec].score});
+        root = insertAt(root, (uint32_t)nodes.size() - 1);
     }
-    void scheduleAfter(uint64_t nowTick, uint64_t afterFrames, function<void()> action) {
-        scheduleAt(nowTick + afterFrames, action);
+    uint32_t size() const { return nodes[root].size; }
+    // Number of entries scoring strictly more than `score`.
+    uint32_t countAbove(int32_t score) const {
+        uint32_t n = 0;
+        for (uint32_t t = root; t; ) {
+            if (nodes[t].score > score) { n += nodes[nodes[t].left].size + 1; t = nodes[t].right; }
+            else t = nodes[t].left;
+        }
+        return n;
     }
-    void process(uint64_t currentTick) {
-        vector<Event> toRun;
-        {
-            lock_guard<mutex> lk(mtx);
-            while (!pq.empty() && pq.top().tick <= currentTick) {
-                toRun.push_back(pq.top()); pq.pop();
-            }
+    // k-th best entry (0-based); k < size().
+    uint32_t at(uint32_t k) const {
+        uint32_t t = root;
+        while (t) {
+            uint32_t ls = nodes[nodes[t].left].size;
+            if (k < ls) t = nodes[t].left;
+            else if (k == ls) return nodes[t].rec;
+            else { k -= ls + 1; t = nodes[t].right; }
         }
-        for (auto &e : toRun) {
-            if (e.action) e.action();
+        return 0;
+    }
+    bool contains(const ScoreRecord &r) const {
+        for (uint32_t t = root; t; ) {
+            if (nodes[t].score != r.score) { t = r.score > nodes[t].score ? nodes[t].left : nodes[t].right; continue; }
+            const ScoreRecord &x = (*recs)[nodes[t].rec];
+            if (x.score == r.score && x.timestamp == r.timestamp && x.seed == r.seed) return true;
+            t = better(r, x) ? nodes[t].left : nodes[t].right;
         }
+        return false;
     }
-    void clear() {
-        lock_guard<mutex> lk(mtx);
-        while (!pq.empty()) pq.pop();
+    // Best n entries, in order: O(log size + n).
+    void top(uint32_t n, vector<ScoreRecord> &out) const {
+        vector<uint32_t> stack;
+        uint32_t t = root;
+        while ((t || !stack.empty()) && out.size() < n) {
+            while (t) { stack.push_back(t); t = nodes[t].left; }
+            t = stack.back(); stack.pop_back();
+            out.push_back((*recs)[nodes[t].rec]);
+            t = nodes[t].right;
+        }
     }
 };
 
-// -------------------- EnemyManager --------------------
-class EnemyManager {
-private:
-    vector<Car> enemies;
-    int level;
+// Which runs a leaderboard query ranks against; -1 means "any".
+// A query may filter by scene or by level (the two indexes are separate).
+struct LeaderboardFilter {
+    int scene = -1;   // SceneType the run ended in
+    int level = -1;   // level the run reached
+};
+
+class Leaderboard {
+    vector<ScoreRecord> records;
+    OrderStatTree all;
+    vector<OrderStatTree> byScene, byLevel;
+    uint64_t changes = 0;
+
+    const OrderStatTree &tree(const LeaderboardFilter &f) const {
+        if (f.scene >= 0 && f.scene < NUM_SCENES) return byScene[f.scene];
+        if (f.level >= 0 && f.level <= MAX_LEVEL) return byLevel[f.level];
+        return all;
+    }
 public:
-    EnemyManager(): level(1) {}
-    const vector<Car>& getEnemies() const { return enemies; }
-    int getLevel() const { return level; }
-    void reset() { enemies.clear(); level = 1; }
-    void setLevel(int newLevel) {
-        if (newLevel < 1) newLevel = 1;
-        if (newLevel > MAX_LEVEL) newLevel = MAX_LEVEL;
-        level = newLevel;
+    Leaderboard(): all(&records), byScene(NUM_SCENES, OrderStatTree(&records)), byLevel(MAX_LEVEL + 1, OrderStatTree(&records)) {}
+    Leaderboard(const Leaderboard&) = delete;
+    Leaderboard &operator=(const Leaderboard&) = delete;
+
+    // Returns false if this exact run (score, time and seed) is already ranked.
+    // Runs migrated from the legacy text file have neither a time nor a seed,
+    // so equal legacy scores are separate runs and are always added.
+    bool add(const ScoreRecord &r) {
+        bool legacy = r.timestamp == 0 && r.seed == 0;
+        if (!legacy && all.contains(r)) return false;
+        uint32_t id = (uint32_t)records.size();
+        records.push_back(r);
+        all.insert(id);
+        if (r.scene < NUM_SCENES) byScene[r.scene].insert(id);
+        if (r.level <= MAX_LEVEL) byLevel[r.level].insert(id);
+        changes++;
+        return true;
     }
-    static float laneCenterX(int lane) { return ROAD_X + 60 + lane * LANE_WIDTH; }
+    uint32_t count(const LeaderboardFilter &f = LeaderboardFilter()) const { return tree(f).size(); }
+    // 1-based position a run with this score takes (ties share the best rank).
+    uint32_t rankOf(int32_t score, const LeaderboardFilter &f = LeaderboardFilter()) const { return tree(f).countAbove(score) + 1; }
+    // Percentage of runs that scored strictly less.
+    float percentBeaten(int32_t score, const LeaderboardFilter &f = LeaderboardFilter()) const {
+        const OrderStatTree &t = tree(f);
+        if (t.size() == 0) return 0.0f;
+        uint32_t atLeast = score == INT32_MIN ? t.size() : t.countAbove(score - 1);
+        return 100.0f * (t.size() - atLeast) / t.size();
+    }
+    // Score at the given percentile (0 = worst, 100 = best).
+    int32_t scoreAtPercentile(float pct, const LeaderboardFilter &f = LeaderboardFilter()) const {
+        const OrderStatTree &t = tree(f);
+        if (t.size() == 0) return 0;
+        uint32_t fromBottom = (uint32_t)(pct / 100.0f * (t.size() - 1) + 0.5f);
+        return records[t.at(t.size() - 1 - min(fromBottom, t.size() - 1))].score;
+    }
+    vector<ScoreRecord> top(uint32_t n, const LeaderboardFilter &f = LeaderboardFilter()) const {
+        vector<ScoreRecord> out;
+        tree(f).top(n, out);
+        return out;
+    }
+    // Bumped on every insert; lets callers cache views.
+    uint64_t version() const { return changes; }
+};
 
-    void spawnAtLane(int chosen) {
-        if (chosen < 0 || chosen >= NUM_LANES) return;
-        float base = 2.2f;
-        float speed = base + pow((float)level, 1.15f) * 0.16f + (rand()%100)/100.0f;
-        Color colors[] = {RED, BLUE, GREEN, ORANGE, PURPLE, PINK, MAROON};
-        enemies.push_back(Car(laneCenterX(chosen), -120.0f, chosen, speed, colors[rand()%7]));
+// -------------------- Leaderboard Service (Unix socket) --------------------
+// A shared leaderboard for several game instances on one machine. The daemon
+// (main --leaderboard-daemon) ranks submitted runs in a Leaderboard and keeps
+// them in its own RunHistory. Every message is a 24-byte LbFrame followed by
+// `count` payload records; clients pipeline several SUBMIT frames before
+// reading the ACKs back in order.
+const uint32_t LB_MAGIC = 0x424C5254;    // "TRLB"
+const uint16_t LB_MAX_BATCH = 256;       // records per SUBMIT frame
+const uint16_t LB_CLIENT_BATCH = 64;
+const int LB_CLIENT_WINDOW = 8;          // SUBMIT frames in flight before waiting for ACKs
+const size_t LB_PENDING_LIMIT = 65536;   // write-behind cache cap; oldest runs drop first
+const double LB_RETRY_SECONDS = 5.0;
+const int LB_IO_TIMEOUT_MS = 1000;
+const int LB_FRAMES_PER_ROUND = 2;      // per client per poll round, so one busy client can't starve the rest
+
+enum LeaderboardOp : uint16_t {
+    LB_SUBMIT = 1,      // client -> daemon: count RunRecords
+    LB_ACK = 2,         // daemon -> client: arg = runs accepted (not duplicates)
+    LB_TOP = 3,         // client -> daemon: arg = n, scene/level filter
+    LB_TOP_REPLY = 4,   // daemon -> client: count ScoreRecords
+    LB_ERROR = 5
+};
+
+struct LbFrame {
+    uint32_t magic;
+    uint16_t op;
+    uint16_t count;
+    uint32_t seq;       // echoed in the reply
+    int32_t arg;
+    uint32_t total;     // replies: runs on the shared board
+    int16_t scene, level;
+};
+static_assert(sizeof(LbFrame) == 24, "LbFrame is a wire format");
+
+static ScoreRecord scoreRecordOf(const RunRecord &h) {
+    ScoreRecord r;
+    memset(&r, 0, sizeof(r));
+    r.timestamp = h.timestamp;
+    r.score = h.score;
+    r.seed = h.seed;
+    r.level = h.level;
+    r.scene = h.finalScene;
+    return r;
+}
+
+// Blocking client connection with short timeouts; used from worker threads.
+class LeaderboardConnection {
+    int fd = -1;
+    uint32_t nextSeq = 1;
+
+#ifndef _WIN32
+    bool sendAll(const void *p, size_t n) {
+        const char *c = (const char*)p;
+        while (n > 0) {
+            ssize_t w = ::send(fd, c, n, MSG_NOSIGNAL);
+            if (w <= 0) { if (w < 0 && errno == EINTR) continue; return false; }
+            c += w; n -= (size_t)w;
+        }
+        return true;
+    }
+    bool recvAll(void *p, size_t n) {
+        char *c = (char*)p;
+        while (n > 0) {
+            ssize_t r = ::recv(fd, c, n, 0);
+            if (r <= 0) { if (r < 0 && errno == EINTR) continue; return false; }
+            c += r; n -= (size_t)r;
+        }
+        return true;
+    }
+#endif
+    bool readAck(uint32_t seq, int &accepted, uint32_t &total) {
+        LbFrame f;
+        if (!recvFrame(f) || f.op != LB_ACK || f.seq != seq) return false;
+        accepted = f.arg;
+        total = f.total;
+        return true;
+    }
+    bool recvFrame(LbFrame &f) {
+#ifndef _WIN32
+        return recvAll(&f, sizeof(f)) && f.magic == LB_MAGIC;
+#else
+        (void)f;
+        return false;
+#endif
+    }
+    static LbFrame frame(uint16_t op, uint16_t count, uint32_t seq) {
+        LbFrame f;
+        memset(&f, 0, sizeof(f));
+        f.magic = LB_MAGIC; f.op = op; f.count = count; f.seq = seq;
+        f.scene = f.level = -1;
+        return f;
     }
 
-    int chooseSafeLane() {
-        const float nearY = 200.0f;
-        const float extendedY = 330.0f;
-        vector<int> candidate;
-        for (int lane = 0; lane < NUM_LANES; ++lane) {
-            bool occupiedNear = false;
-            for (auto &e : enemies) {
-                if (e.getLane() == lane && e.getPos().y < nearY) { occupiedNear = true; break; }
+public:
+    LeaderboardConnection() {}
+    LeaderboardConnection(const LeaderboardConnection&) = delete;
+    LeaderboardConnection &operator=(const LeaderboardConnection&) = delete;
+    ~LeaderboardConnection() { close(); }
+
+    bool open(const string &socketPath) {
+        close();
+#ifndef _WIN32
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(addr.sun_path)) return false;
+        memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        // Without both timeouts a stalled daemon would block the stream's worker
+        timeval tv = { LB_IO_TIMEOUT_MS / 1000, (LB_IO_TIMEOUT_MS % 1000) * 1000 };
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0) { close(); return false; }
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) { close(); return false; }
+        return true;
+#else
+        (void)socketPath;
+        return false;   // no Unix sockets: runs stay in the local write-behind cache
+#endif
+    }
+    void close() {
+#ifndef _WIN32
+        if (fd >= 0) ::close(fd);
+#endif
+        fd = -1;
+    }
+    bool connected() const { return fd >= 0; }
+
+    // Sends runs in frames of `batch`, keeping up to `window` frames unacknowledged.
+    // `acked` is the number of leading runs the daemon has confirmed; on error the
+    // connection is closed and the rest should be resent later.
+    bool submit(const RunRecord *runs, size_t n, size_t batch, int window, size_t &acked, uint32_t *total = nullptr) {
+        acked = 0;
+        if (fd < 0) return false;
+#ifndef _WIN32
+        deque<pair<uint32_t, size_t>> inFlight;     // seq, records
+        size_t sent = 0;
+        while (acked < n) {
+            while (sent < n && (int)inFlight.size() < window) {
+                uint16_t cnt = (uint16_t)min(batch, n - sent);
+                LbFrame f = frame(LB_SUBMIT, cnt, nextSeq++);
+                if (!sendAll(&f, sizeof(f)) || !sendAll(runs + sent, cnt * sizeof(RunRecord))) { close(); return false; }
+                inFlight.push_back(make_pair(f.seq, (size_t)cnt));
+                sent += cnt;
             }
-            if (!occupiedNear) candidate.push_back(lane);
+            int accepted; uint32_t t;
+            if (!readAck(inFlight.front().first, accepted, t)) { close(); return false; }
+            acked += inFlight.front().second;
+            inFlight.pop_front();
+            if (total) *total = t;
         }
-        vector<int> safe;
-        for (int lane : candidate) {
-            bool adjBlocked = false;
-            for (auto &e : enemies) {
-                if (e.getPos().y < extendedY && abs(e.getLane() - lane) == 1) { adjBlocked = true; break; }
+        return true;
+#else
+        (void)runs; (void)n; (void)batch; (void)window; (void)total;
+        return false;
+#endif
+    }
+
+    bool top(uint16_t n, const LeaderboardFilter &filter, vector<ScoreRecord> &out, uint32_t &total) {
+        if (fd < 0) return false;
+#ifndef _WIN32
+        LbFrame f = frame(LB_TOP, 0, nextSeq++);
+        f.arg = n; f.scene = (int16_t)filter.scene; f.level = (int16_t)filter.level;
+        LbFrame r;
+        if (!sendAll(&f, sizeof(f)) || !recvFrame(r) || r.op != LB_TOP_REPLY || r.seq != f.seq) { close(); return false; }
+        out.resize(r.count);
+        if (r.count && !recvAll(out.data(), r.count * sizeof(ScoreRecord))) { close(); return false; }
+        total = r.total;
+        return true;
+#else
+        (void)n; (void)filter; (void)out; (void)total;
+        return false;
+#endif
+    }
+};
+
+// Single-threaded poll() loop; hundreds of clients share one Leaderboard.
+class LeaderboardDaemon {
+    struct Client { int fd; string in, out; };
+    string socketPath;
+    JobQueue jobs;
+    RunHistory history;
+    Leaderboard board;
+    vector<Client> clients;
+    uint64_t submitted = 0, accepted = 0;
+
+#ifndef _WIN32
+    void handleFrame(Client &c, const LbFrame &f, const char *payload) {
+        LbFrame reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.magic = LB_MAGIC; reply.seq = f.seq; reply.scene = reply.level = -1;
+        if (f.op == LB_SUBMIT) {
+            int added = 0;
+            for (uint16_t i = 0; i < f.count; ++i) {
+                RunRecord r;
+                memcpy(&r, payload + i * sizeof(RunRecord), sizeof(r));
+                if (!runRecordValid(r)) continue;
+                // Resent batches (an ACK lost to a dropped connection) are deduplicated here
+                if (board.add(scoreRecordOf(r))) { history.append(r); added++; }
             }
-            if (!adjBlocked) safe.push_back(lane);
+            submitted += f.count; accepted += added;
+            reply.op = LB_ACK; reply.arg = added; reply.total = board.count();
+            c.out.append((const char*)&reply, sizeof(reply));
+        } else if (f.op == LB_TOP) {
+            LeaderboardFilter filter;
+            filter.scene = f.scene; filter.level = f.level;
+            vector<ScoreRecord> top = board.top((uint32_t)max(0, min<int>(f.arg, LB_MAX_BATCH)), filter);
+            reply.op = LB_TOP_REPLY; reply.count = (uint16_t)top.size(); reply.total = board.count(filter);
+            c.out.append((const char*)&reply, sizeof(reply));
+            c.out.append((const char*)top.data(), top.size() * sizeof(ScoreRecord));
+        } else {
+            reply.op = LB_ERROR;
+            c.out.append((const char*)&reply, sizeof(reply));
         }
-        int chosen = -1;
-        if (!safe.empty()) chosen = safe[rand() % safe.size()];
-        else if (!candidate.empty()) chosen = candidate[rand() % candidate.size()];
-        return chosen;
     }
-
-    void update(bool slowMotion) {
-        float speedMult = slowMotion ? 0.5f : 1.0f;
-        for (size_t i=0;i<enemies.size();++i) {
-            enemies[i].update(speedMult);
+    // Consumes up to LB_FRAMES_PER_ROUND complete frames from c.in; false drops the client.
+    bool parse(Client &c) {
+        size_t pos = 0;
+        for (int n = 0; n < LB_FRAMES_PER_ROUND && c.in.size() - pos >= sizeof(LbFrame); ++n) {
+            LbFrame f;
+            memcpy(&f, c.in.data() + pos, sizeof(f));
+            size_t payload = f.op == LB_SUBMIT ? f.count * sizeof(RunRecord) : 0;
+            if (f.magic != LB_MAGIC || f.count > LB_MAX_BATCH) return false;
+            if (c.in.size() - pos < sizeof(f) + payload) break;
+            handleFrame(c, f, c.in.data() + pos + sizeof(f));
+            pos += sizeof(f) + payload;
         }
-        enemies.erase(remove_if(enemies.begin(), enemies.end(),
-                    [](const Car &c){ return c.getPos().y > SCREEN_HEIGHT + 150; }), enemies.end());
+        c.in.erase(0, pos);
+        return true;
     }
+    static bool hasFrame(const Client &c) {
+        if (c.in.size() < sizeof(LbFrame)) return false;
+        LbFrame f;
+        memcpy(&f, c.in.data(), sizeof(f));
+        return c.in.size() >= sizeof(f) + (f.op == LB_SUBMIT ? f.count * sizeof(RunRecord) : 0);
+    }
+    static bool flushOut(Client &c) {
+        while (!c.out.empty()) {
+            ssize_t w = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            if (w <= 0) return false;
+            c.out.erase(0, (size_t)w);
+        }
+        return true;
+    }
+#endif
+
+public:
+    LeaderboardDaemon(const string &socket, const string &historyBase): socketPath(socket), history(historyBase) {}
+
+    // Serves until *stop becomes true. Returns a process exit code.
+    int run(const atomic<bool> &stop, atomic<bool> *ready = nullptr) {
+#ifndef _WIN32
+        history.open(jobs);
+        jobs.submit(JOB_STREAM_HISTORY, [this]() {     // after recovery
+            history.forEachRun([this](const RunRecord &r) { board.add(scoreRecordOf(r)); });
+        }).get();
+        TraceLog(LOG_INFO, "LEADERBOARD: %u runs loaded, listening on %s", board.count(), socketPath.c_str());
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(addr.sun_path)) { TraceLog(LOG_WARNING, "LEADERBOARD: Socket path too long"); return 1; }
+        memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+        int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socketPath.c_str());
+        if (lfd < 0 || bind(lfd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(lfd, 1024) != 0) {
+            TraceLog(LOG_WARNING, "LEADERBOARD: Cannot listen on %s: %s", socketPath.c_str(), strerror(errno));
+            if (lfd >= 0) ::close(lfd);
+            return 1;
+        }
+        fcntl(lfd, F_SETFL, O_NONBLOCK);
+        if (ready) ready->store(true);
 
-    void draw() const { for (auto &e : enemies) e.draw(); }
+        vector<pollfd> fds;
+        char buf[64 * 1024];
+        while (!stop.load()) {
+            fds.clear();
+            fds.push_back(pollfd{ lfd, POLLIN, 0 });
+            bool backlog = false;   // frames already buffered from an earlier round
+            for (auto &c : clients) {
+                fds.push_back(pollfd{ c.fd, (short)(POLLIN | (c.out.empty() ? 0 : POLLOUT)), 0 });
+                backlog = backlog || hasFrame(c);
+            }
+            if (poll(fds.data(), fds.size(), backlog ? 0 : 100) < 0) continue;
+
+            if (fds[0].revents & POLLIN) {
+                int cfd;
+                while ((cfd = accept(lfd, nullptr, nullptr)) >= 0) {
+                    fcntl(cfd, F_SETFL, O_NONBLOCK);
+                    clients.push_back(Client{ cfd, string(), string() });
+                }
+            }
+            // fds[i + 1] belongs to clients[i] for the clients that existed before accept()
+            for (size_t i = fds.size() - 1; i >= 1; --i) {
+                Client &c = clients[i - 1];
+                bool alive = true;
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    ssize_t r;
+                    while ((r = ::recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) c.in.append(buf, (size_t)r);
+                    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) alive = false;
+                }
+                if (alive && !parse(c)) alive = false;
+                if (alive && !flushOut(c)) alive = false;
+                if (!alive) {
+                    ::close(c.fd);
+                    clients.erase(clients.begin() + (i - 1));
+                }
+            }
+        }
+        for (auto &c : clients) ::close(c.fd);
+        clients.clear();
+        ::close(lfd);
+        unlink(socketPath.c_str());
+        jobs.shutdown();
+        TraceLog(LOG_INFO, "LEADERBOARD: Stopped; %llu runs submitted, %llu new", (unsigned long long)submitted, (unsigned long long)accepted);
+        return 0;
+#else
+        (void)stop; (void)ready;
+        TraceLog(LOG_WARNING, "LEADERBOARD: The leaderboard daemon needs Unix domain sockets");
+        return 1;
+#endif
+    }
 };
 
-// -------------------- PowerUpManager --------------------
-class PowerUpManager {
-private:
-    vector<PowerUp> list;
-public:
-    PowerUpManager() {}
-    vector<PowerUp>& getPowerUps() { return list; }
-    void reset() { list.clear(); }
+// Game-side submitter. Runs queue up in a write-behind cache (persisted so a
+// crash or an offline daemon loses nothing) and are drained in pipelined
+// batches by one job at a time on the leaderboard stream.
+class LeaderboardClient {
+    struct State {
+        string socketPath;
+        mutex mtx;
+        deque<RunRecord> pending;
+        uint64_t dropped = 0;           // runs evicted from the front by LB_PENDING_LIMIT
+        string cachePath;
+        bool cacheLoaded = false;
+        bool cacheHasRuns = false;      // the cache file on disk is non-empty
+        bool flushQueued = false;
+        bool online = false;
+        uint32_t sharedTotal = 0;
+        chrono::steady_clock::time_point retryAt;
+        LeaderboardConnection conn;     // only touched by the flush job
+        SnapshotWriter cache;
+        explicit State(const string &cachePath): cache(cachePath) {}
+    };
+    shared_ptr<State> st;
 
-    static float laneCenterX(int lane) { return ROAD_X + 60 + lane * LANE_WIDTH; }
+    static string encode(const deque<RunRecord> &runs) {
+        string bytes;
+        bytes.reserve(runs.size() * sizeof(RunRecord));
+        for (auto &r : runs) bytes.append((const char*)&r, sizeof(r));
+        return bytes;
+    }
+    static void flushJob(shared_ptr<State> s, JobQueue *jobs) {
+        vector<RunRecord> batch;
+        uint64_t droppedBefore;
+        {
+            lock_guard<mutex> lk(s->mtx);
+            batch.assign(s->pending.begin(), s->pending.end());
+            droppedBefore = s->dropped;
+        }
+        size_t acked = 0;
+        uint32_t total = 0;
+        bool ok = (s->conn.connected() || s->conn.open(s->socketPath)) &&
+                  s->conn.submit(batch.data(), batch.size(), LB_CLIENT_BATCH, LB_CLIENT_WINDOW, acked, &total);
+        lock_guard<mutex> lk(s->mtx);
+        // Acked runs are at the front, minus any evicted meanwhile; new runs were appended behind
+        uint64_t evicted = s->dropped - droppedBefore;
+        for (size_t i = evicted; i < acked && !s->pending.empty(); ++i) s->pending.pop_front();
+        if (ok && total) s->sharedTotal = total;
+        if (ok != s->online) TraceLog(LOG_INFO, "LEADERBOARD: Shared leaderboard %s", ok ? "online" : "offline, caching runs locally");
+        s->online = ok;
+        if (!ok) s->retryAt = chrono::steady_clock::now() + chrono::milliseconds((int)(LB_RETRY_SECONDS * 1000));
+        s->flushQueued = false;
+        // Persist what is still unsent whenever the on-disk cache would otherwise be stale
+        if (!ok || s->cacheHasRuns) {
+            s->cache.save(*jobs, JOB_STREAM_LEADERBOARD, encode(s->pending), (int)s->pending.size());
+            s->cacheHasRuns = !s->pending.empty();
+        }
+    }
 
-    void spawnAtLane(int lane) {
-        if (lane < 0 || lane >= NUM_LANES) return;
-        PowerUpType types[] = { SHIELD, SLOW_MOTION, SCORE_MULTIPLIER, EXTRA_LIFE };
-        PowerUpType t = types[rand() % 4];
-        list.push_back(PowerUp(laneCenterX(lane), -80.0f, t));
+public:
+    LeaderboardClient(const string &socketPath, const string &cachePath): st(make_shared<State>(cachePath)) {
+        st->socketPath = socketPath;
+        st->cachePath = cachePath;
     }
 
-    int chooseFreeLaneBasedOnEnemies(const EnemyManager &enemyMgr) {
-        const float safeY = 320.0f;
-        vector<int> freeLanes;
-        for (int lane = 0; lane < NUM_LANES; ++lane) {
-            bool blocked = false;
-            for (auto &e : enemyMgr.getEnemies()) {
-                if (e.getLane() == lane && e.getPos().y < safeY) { blocked = true; break; }
-            }
-            if (!blocked) freeLanes.push_back(lane);
+    // Reads runs cached by an earlier session (callable from a worker). Nothing
+    // is sent before this, so the cache file is never overwritten unread.
+    void loadCache() {
+        vector<RunRecord> cached;
+        MappedFile f;
+        if (f.open(st->cachePath)) {
+            const RunRecord *runs = (const RunRecord*)f.data();
+            for (size_t i = 0; i < f.size() / sizeof(RunRecord); ++i) if (runRecordValid(runs[i])) cached.push_back(runs[i]);
+        }
+        lock_guard<mutex> lk(st->mtx);
+        st->pending.insert(st->pending.begin(), cached.begin(), cached.end());
+        st->cacheHasRuns = !cached.empty();
+        st->cacheLoaded = true;
+        if (!cached.empty()) TraceLog(LOG_INFO, "LEADERBOARD: %d cached runs awaiting submission", (int)cached.size());
+    }
+
+    void submit(JobQueue &jobs, RunRecord r) {
+        sealRunRecord(r);
+        {
+            lock_guard<mutex> lk(st->mtx);
+            st->pending.push_back(r);
+            if (st->pending.size() > LB_PENDING_LIMIT) { st->pending.pop_front(); st->dropped++; }
+            st->retryAt = chrono::steady_clock::time_point(); // a new run is worth an immediate try
+        }
+        pump(jobs);
+    }
+    // Cheap; call once per frame. Queues a flush when runs are waiting and the
+    // retry back-off has elapsed.
+    void pump(JobQueue &jobs) {
+        shared_ptr<State> s = st;
+        {
+            lock_guard<mutex> lk(s->mtx);
+            if (!s->cacheLoaded || s->flushQueued || s->pending.empty() || chrono::steady_clock::now() < s->retryAt) return;
+            s->flushQueued = true;
         }
-        if (!freeLanes.empty()) return freeLanes[rand() % freeLanes.size()];
-        return -1;
+        JobQueue *q = &jobs;
+        jobs.push(JOB_STREAM_LEADERBOARD, [s, q]() { flushJob(s, q); });
     }
-
-    void update() {
-        for (auto &p : list) p.update();
-        list.erase(remove_if(list.begin(), list.end(),
-            [](const PowerUp &u){ return u.getPos().y > SCREEN_HEIGHT + 120 || u.isCollected(); }), list.end());
+    // Fetches the shared top-N; fails when the daemon is unreachable.
+    Future<vector<ScoreRecord>> fetchTop(JobQueue &jobs, uint16_t n, const LeaderboardFilter &filter = LeaderboardFilter()) {
+        shared_ptr<State> s = st;
+        return jobs.submit(JOB_STREAM_LEADERBOARD, [s, n, filter]() {
+            vector<ScoreRecord> out;
+            uint32_t total = 0;
+            if (!(s->conn.connected() || s->conn.open(s->socketPath)) || !s->conn.top(n, filter, out, total))
+                throw runtime_error("shared leaderboard offline");
+            lock_guard<mutex> lk(s->mtx);
+            s->sharedTotal = total;
+            return out;
+        });
     }
-    void draw() const { for (auto &p : list) p.draw(); }
+    bool online() const { lock_guard<mutex> lk(st->mtx); return st->online; }
+    uint32_t sharedTotal() const { lock_guard<mutex> lk(st->mtx); return st->sharedTotal; }
+    size_t pendingCount() const { lock_guard<mutex> lk(st->mtx); return st->pending.size(); }
+    bool flushCache(double seconds) { return st->cache.flush(seconds); }
+};
+
+// Everything ScoreManager reads from disk, built on a worker and merged in on
+// the main thread.
+struct LoadedScores {
+    vector<ScoreRecord> top;
+    shared_ptr<Leaderboard> board = make_shared<Leaderboard>();
+    shared_ptr<ScoreSketches> sketches = make_shared<ScoreSketches>();
+    uint32_t historyRuns = 0;
+    double ms = 0;
 };
 
 // -------------------- ScoreManager --------------------
 class ScoreManager {
 private:
+    struct ByScore {
+        bool operator()(const ScoreRecord &a, const ScoreRecord &b) const {
+            if (a.score != b.score) return a.score > b.score;
+            return a.timestamp > b.timestamp; // among equal scores the oldest is evicted first, so getTopRecords lists the newest first
+        }
+    };
     int currentScore;
     int highScore;
-    priority_queue<int, vector<int>, greater<int>> topScores;
+    priority_queue<ScoreRecord, vector<ScoreRecord>, ByScore> topScores;
     int streak;
     int maxStreak;
     int multiplier;
+    bool runRecorded;
+    string path;
+    SnapshotWriter writer;
+    LeaderboardClient shared;   // submissions to the shared daemon, cached while it is down
+    shared_ptr<Leaderboard> board;  // every recorded run, not just the top K
+    ScoreSketches sketches;     // fixed-size score / survival distributions, saved with the scores
+    RunStanding last;
+    ScoreRecord lastRecord;
+    uint32_t lastFrames;
+    // Cached top-N for the score screens; rebuilt only when the board changes
+    vector<ScoreRecord> view;
+    const Leaderboard *viewBoard;
+    uint64_t viewVersion;
+    uint32_t viewSize;
+    LeaderboardFilter viewFilter;
+
+    // Background load: until it lands, finished runs are kept aside and saves
+    // are held back so they can't overwrite the file with a partial table.
+    bool loaded;
+    Future<shared_ptr<LoadedScores>> loadJob;
+    JobQueue *jobs;
+    FrameDispatcher *dispatcher;
+    vector<ScoreRecord> sessionRuns;
+    vector<Promise<int>> deferredSaves;
+
 public:
-    ScoreManager(): currentScore(0), highScore(0), streak(0), maxStreak(0), multiplier(1) {
-        load();
+    explicit ScoreManager(const string &file = "traffic_scores.dat", const string &socket = LEADERBOARD_SOCKET)
+        : currentScore(0), highScore(0), streak(0), maxStreak(0), multiplier(1),
+          runRecorded(true), path(file), writer(file), shared(socket, file + ".pending"), board(make_shared<Leaderboard>()),
+          lastFrames(0), viewBoard(nullptr), viewVersion(0), viewSize(0), loaded(false), jobs(nullptr), dispatcher(nullptr) {
+        memset(&lastRecord, 0, sizeof(lastRecord));
     }
     void addScore(int pts) { currentScore += pts * multiplier; streak++; if (streak > maxStreak) maxStreak = streak; }
     void resetStreak() { streak = 0; }
@@ -712,69 +4583,204 @@ public:
     int getHigh() const { return highScore; }
     int getStreak() const { return streak; }
     int getMaxStreak() const { return maxStreak; }
-    vector<int> getTopScores() const {
-        vector<int> v;
+    bool isLoaded() const { return loaded; }
+    vector<ScoreRecord> getTopRecords() const {
+        vector<ScoreRecord> v;
         auto copy = topScores;
         while (!copy.empty()) { v.push_back(copy.top()); copy.pop(); }
-        sort(v.begin(), v.end(), greater<int>());
+        reverse(v.begin(), v.end());
         return v;
     }
-    void saveScoreAsync(JobQueue &jobQueue) {
-        updateTopK(currentScore);
-        vector<int> toWrite = getTopScores();
-        jobQueue.push([toWrite](){
-            ofstream f("traffic_scores.dat");
-            if (f.is_open()) {
-                for (auto &v : toWrite) f << v << endl;
-                f.close();
-            }
-        });
+    const Leaderboard &getLeaderboard() const { return *board; }
+    // Rank and percentiles of the last recorded run.
+    const RunStanding &getLastStanding() const { return last; }
+    const ScoreSketches &getSketches() const { return sketches; }
+    const vector<ScoreRecord> &topView(uint32_t n, const LeaderboardFilter &f = LeaderboardFilter()) {
+        if (viewBoard != board.get() || viewVersion != board->version() || viewSize != n || viewFilter.scene != f.scene || viewFilter.level != f.level) {
+            view = board->top(n, f);
+            viewBoard = board.get(); viewVersion = board->version(); viewSize = n; viewFilter = f;
+        }
+        return view;
+    }
+
+    // Reads the score file, the run history and the shared-leaderboard cache on
+    // the history stream (after the history's own recovery) and merges them in
+    // on the main thread. Resolves once the scores are in place.
+    Future<Unit> loadAsync(JobQueue &jobQueue, FrameDispatcher &disp, const RunHistory &history) {
+        jobs = &jobQueue;
+        dispatcher = &disp;
+        const RunHistory *h = &history;
+        loadJob = jobQueue.submit(JOB_STREAM_HISTORY, [this, h]() { return readFiles(*h); });
+        // A failed read still unblocks the held-back saves, starting from this session's runs
+        loadJob.onError(disp, [this](const string&) { LoadedScores none; install(none); });
+        return loadJob.then(disp, [this](const shared_ptr<LoadedScores> &l) { install(*l); });
     }
-    void saveScoreSync() {
-        updateTopK(currentScore);
-        ofstream f("traffic_scores.dat");
-        if (f.is_open()) {
-            auto v = getTopScores();
-            for (auto &s : v) f << s << endl;
-            f.close();
+
+    // Resolves to the number of scores written; fails if the file could not be written.
+    // Saves requested while one is in flight are coalesced into one write.
+    Future<int> saveScoreAsync(JobQueue &jobQueue, const RunInfo &run) {
+        recordRun(run);
+        if (!loaded) {
+            Promise<int> p;
+            deferredSaves.push_back(p);
+            return p.future();
         }
+        vector<ScoreRecord> v = getTopRecords();
+        return writer.save(jobQueue, JOB_STREAM_SCORES, ScoreFileView::serialize(v, sketches.encode()), (int)v.size());
     }
-    void reset() { currentScore = 0; streak = 0; multiplier = 1; }
-private:
-    void updateTopK(int score) {
-        if ((int)topScores.size() < TOP_K_SCORES) topScores.push(score);
-        else {
-            if (score > topScores.top()) {
-                topScores.pop();
-                topScores.push(score);
+    // Bounded wait for pending saves; the newest snapshot always wins. Waits
+    // for a still-running load first so held-back saves can go out.
+    bool flush(double seconds) {
+        if (!loaded && loadJob.valid() && loadJob.waitFor(seconds)) {
+            // The merge is posted just after the job completes; give it a moment to arrive
+            auto deadline = chrono::steady_clock::now() + chrono::milliseconds(100);
+            while (!loaded && chrono::steady_clock::now() < deadline) {
+                dispatcher->drain();
+                if (!loaded) this_thread::yield();
             }
         }
-        vector<int> tmp;
-        {
-            auto copy = topScores;
-            while (!copy.empty()) { tmp.push_back(copy.top()); copy.pop(); }
+        if (!loaded && loadJob.valid())
+            TraceLog(LOG_WARNING, "SCORES: Load still running at shutdown; this session's scores are only in the history");
+        bool ok = writer.flush(seconds);
+        return shared.flushCache(seconds) && ok;
+    }
+    // Queues a finished run for the shared leaderboard.
+    void shareRun(JobQueue &jobQueue, const RunRecord &r) { shared.submit(jobQueue, r); }
+    void pumpShared(JobQueue &jobQueue) { shared.pump(jobQueue); }
+    LeaderboardClient &sharedBoard() { return shared; }
+    void reset() { currentScore = 0; streak = 0; maxStreak = 0; multiplier = 1; runRecorded = false; }
+private:
+    // A run enters the top-K once, however many times it is saved
+    // (game over, quit to menu and shutdown can all save the same run).
+    void recordRun(const RunInfo &run) {
+        if (runRecorded) return;
+        ScoreRecord r;
+        memset(&r, 0, sizeof(r));
+        r.timestamp = run.timestamp;
+        r.score = currentScore;
+        r.seed = run.seed;
+        r.level = (uint16_t)run.level;
+        r.scene = (uint8_t)run.scene;
+        updateTopK(r);
+        board->add(r);
+        if (!loaded) sessionRuns.push_back(r);
+        // Percentiles against the runs before this one, then fold it in
+        standing(r, run.frames, true);
+        lastRecord = r;
+        lastFrames = run.frames;
+        runRecorded = true;
+    }
+    void standing(const ScoreRecord &r, uint32_t frames, bool addToSketches) {
+        QuantileSketch &lv = sketches.survival[min<int>(r.level, MAX_LEVEL)];
+        last.rank = board->rankOf(r.score);
+        last.scoreBeaten = sketches.scores.empty() ? 100.0f : (float)(100.0 * sketches.scores.cdf(r.score - 0.5));
+        last.survivalBeaten = lv.empty() ? 100.0f : (float)(100.0 * lv.cdf(frames - 0.5));
+        if (addToSketches) sketches.add(r.score, r.level, frames);
+        last.levelMedianSec = (float)(lv.quantile(0.5) / FRAMES_PER_SEC);
+        last.levelP90Sec = (float)(lv.quantile(0.9) / FRAMES_PER_SEC);
+        last.levelRuns = (uint32_t)lv.count();
+    }
+    void updateTopK(const ScoreRecord &r) {
+        if ((int)topScores.size() < TOP_K_SCORES) topScores.push(r);
+        else if (r.score > topScores.top().score) {
+            topScores.pop();
+            topScores.push(r);
         }
-        if (!tmp.empty()) highScore = *max_element(tmp.begin(), tmp.end());
-        else highScore = max(highScore, 0);
+        highScore = max(highScore, r.score);
     }
-    void load() {
-        topScores = priority_queue<int, vector<int>, greater<int>>();
-        ifstream f("traffic_scores.dat");
-        if (f.is_open()) {
-            int s; vector<int> loaded;
-            while (f >> s) {
-                loaded.push_back(s);
-            }
-            f.close();
-            for (int s : loaded) {
-                if ((int)topScores.size() < TOP_K_SCORES) topScores.push(s);
-                else if (s > topScores.top()) { topScores.pop(); topScores.push(s); }
-            }
+
+    // Main thread: merge what was read with the runs finished meanwhile.
+    void install(LoadedScores &l) {
+        for (auto &r : l.top) updateTopK(r);
+        for (auto &r : sessionRuns) l.board->add(r);
+        board = l.board;
+        sketches.merge(*l.sketches);
+        loaded = true;
+        if (!sessionRuns.empty()) standing(lastRecord, lastFrames, false);
+        sessionRuns.clear();
+        TraceLog(LOG_INFO, "SCORES: %u runs ranked (%u from history), read in %.1f ms on a worker",
+                 board->count(), l.historyRuns, l.ms);
+        if (!deferredSaves.empty()) {
+            vector<Promise<int>> waiting;
+            waiting.swap(deferredSaves);
+            vector<ScoreRecord> v = getTopRecords();
+            Future<int> f = writer.save(*jobs, JOB_STREAM_SCORES, ScoreFileView::serialize(v, sketches.encode()), (int)v.size());
+            f.then(*dispatcher, [waiting](const int &n) { for (Promise<int> p : waiting) p.setValue(n); })
+             .onError(*dispatcher, [waiting](const string &err) {
+                for (Promise<int> p : waiting) p.setError(make_exception_ptr(runtime_error(err)));
+             });
         }
-        vector<int> tmp;
-        auto copy = topScores;
-        while(!copy.empty()) { tmp.push_back(copy.top()); copy.pop(); }
-        if (!tmp.empty()) highScore = *max_element(tmp.begin(), tmp.end()); else highScore = 0;
+    }
+
+    // Worker: everything below touches only the files and its own result.
+    shared_ptr<LoadedScores> readFiles(const RunHistory &history) {
+        auto t0 = chrono::steady_clock::now();
+        shared_ptr<LoadedScores> l = make_shared<LoadedScores>();
+        bool haveSketches = readScoreFile(*l);
+        history.forEachRun([&l, haveSketches](const RunRecord &h) {
+            if (l->board->add(scoreRecordOf(h))) l->historyRuns++;
+            if (!haveSketches) l->sketches->add(h.score, h.level, h.frames);
+        });
+        shared.loadCache();
+        l->ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        return l;
+    }
+    // Returns whether the file carried sketches; if not they are rebuilt from the history.
+    bool readScoreFile(LoadedScores &l) {
+        MappedFile file;
+        if (!file.open(path) || file.size() == 0) return false;
+
+        if (!ScoreFileView::looksBinary(file.data(), file.size())) {
+            migrateLegacyText(file, l);
+            return false;
+        }
+        ScoreFileView view;
+        string err = view.open(file.data(), file.size());
+        const ScoreRecord *recs = err.empty() ? view.prefix(TOP_K_SCORES) : nullptr;
+        if (!recs) {
+            if (err.empty()) err = "record checksum mismatch";
+            file.close();
+            quarantine(err);
+            return false;
+        }
+        uint32_t n = min<uint32_t>(view.count(), TOP_K_SCORES);
+        for (uint32_t i = 0; i < n; ++i) { l.top.push_back(recs[i]); l.board->add(recs[i]); }
+        // An empty section (e.g. right after a legacy migration) also means "rebuild"
+        const unsigned char *payload;
+        size_t bytes;
+        bool ok = view.sketches(payload, bytes) && bytes > 0 && l.sketches->decode(payload, bytes);
+        if (!ok) l.sketches->clear();
+        return ok;
+    }
+    // Pre-binary files: whitespace-separated scores. Converted in place, the
+    // original kept alongside as <file>.legacy.
+    void migrateLegacyText(MappedFile &file, LoadedScores &l) {
+        istringstream in(string((const char*)file.data(), file.size()));
+        int s;
+        while (in >> s) {
+            ScoreRecord r;
+            memset(&r, 0, sizeof(r));
+            r.score = s;
+            r.scene = SCENE_UNKNOWN;
+            l.top.push_back(r);
+        }
+        sort(l.top.begin(), l.top.end(), [](const ScoreRecord &a, const ScoreRecord &b) { return a.score > b.score; });
+        if ((int)l.top.size() > TOP_K_SCORES) l.top.resize(TOP_K_SCORES);
+        for (auto &r : l.top) l.board->add(r);
+        file.close();
+        error_code ec;
+        filesystem::copy_file(path, path + ".legacy", filesystem::copy_options::overwrite_existing, ec);
+        try {
+            writer.saveNow(ScoreFileView::serialize(l.top));
+            TraceLog(LOG_INFO, "SCORES: Migrated %d legacy scores to binary format", (int)l.top.size());
+        } catch (const exception &e) {
+            TraceLog(LOG_WARNING, "SCORES: Legacy migration failed: %s", e.what());
+        }
+    }
+    void quarantine(const string &why) {
+        TraceLog(LOG_WARNING, "SCORES: %s is unreadable (%s); moved to %s.corrupt", path.c_str(), why.c_str(), path.c_str());
+        error_code ec;
+        filesystem::rename(path, path + ".corrupt", ec);
     }
 };
 
@@ -782,6 +4788,10 @@ private:
 class TrafficRacingGame {
 private:
     Car player;
+    CarAtlas carAtlas;
+    RoadRenderer road;
+    RenderScaler world;
+    QualityGovernor quality;
     EnemyManager enemyMgr;
     PowerUpManager powerUpMgr;
     ScoreManager scoreMgr;
@@ -794,9 +4804,17 @@ private:
     uint64_t frameCount;
     float invincibilityTimer;
     int menuSelection;
+    int scoresFilter;   // scene shown on the scores screen, -1 for all
+    bool scoresShared;  // scores screen shows the shared daemon's board
+    vector<ScoreRecord> sharedTop;
+    string sharedTopStatus;     // "" once sharedTop is current
+    uint32_t sharedTopGen;
+    uint32_t runSeed;   // srand() seed of the current run, stored with its score
+    bool runActive;     // a run has started and not yet been written to the history
+    int runCollisions;
+    uint8_t runScenes;  // bitmask of scenes visited this run
 
-    struct Particle { Vector2 pos, vel; Color col; float life, size; };
-    vector<Particle> particles;
+    ParticleSystem particles;
     
     // Camera shake
     float shakeIntensity;
@@ -814,13 +4832,47 @@ private:
     // New components
     Quadtree *qtRoot;
     EventScheduler scheduler;
+    ScriptRunner scripts;
+    FrameDispatcher dispatcher; // must outlive jobQueue: workers post into it
     JobQueue jobQueue;
+    AssetStreamer streamer;
+    RunHistory history;
+
+    // PLAYING update phases; sounds raised inside tasks are played afterwards
+    FrameTaskGraph updateGraph;
+    bool pendingSfxHit, pendingSfxPowerup, pendingPlayerHit;
+    bool updateLevelUp;
+    SceneType updateSceneBefore;
+
+    // Gameplay frames are recorded into two lists. With the pipeline on, a
+    // job runs frame N+1's update and records it into one list while the
+    // main thread submits frame N from the other.
+    DrawList drawLists[2];
+    int frontList;          // the list submitted this frame
+    bool frontValid;        // it holds a frame of the current run
+    bool pipelineEnabled;
+    Future<Unit> updateJob;
+    bool persistRuns;       // off for headless runs: nothing is saved or logged
+
+    // Transient status line (e.g. a failed score save)
+    string statusText;
+    float statusTimer;
+
+    // PAUSED, GAME_OVER and SCORES draw their overlay on a still of the
+    // last live frame instead of redrawing the world every frame
+    RenderTexture2D frozen;
+    bool frozenValid, frozenFailed;
+    GameState liveState;    // last state drawn live (PLAYING or MENU)
+    double idleSince;
+    bool idleMode;
 
     mutex schedMtx;
 
     static float laneCenterX(int lane) { return ROAD_X + 60 + lane * LANE_WIDTH; }
 
     void triggerShake(float intensity, float duration) {
+        intensity *= quality.tier().shake;
+        if (intensity <= 0) return;
         shakeIntensity = intensity;
         shakeDuration = duration;
     }
@@ -838,77 +4890,190 @@ private:
         }
     }
 
-    void createParticles(float x, float y, Color c, int count=20) {
-        for (int i=0;i<count;++i) {
-            Particle p;
-            p.pos = { x, y };
-            float ang = (rand()%360) * DEG2RAD;
-            float sp = 1.5f + (rand()%100) / 60.0f;
-            p.vel = { cos(ang)*sp, sin(ang)*sp };
-            p.col = c; p.life = 1.0f; p.size = 2.0f + (rand()%50)/50.0f;
-            particles.push_back(p);
+    void updateParticles() { particles.update(); }
+    RaylibRenderer screen(RenderScaler *worldPass) { return RaylibRenderer(sceneMgr, road, carAtlas, particles, worldPass); }
+
+    // Bakes whatever layers are stale; call outside BeginDrawing. Each bake
+    // logs the draw calls per frame it saves, both numbers counted by a
+    // RecordingRenderer walking the same draw code without and with it.
+    void prepareLayers(Renderer &r) {
+        bool sceneBaked = sceneMgr.prepareBackground(r);
+        bool roadBaked = road.prepare(r, sceneMgr.getRoadColor(), sceneMgr.getLineColor());
+        if (!sceneBaked && !roadBaked) return;
+        RecordingRenderer rec = recorder(nullptr);
+        if (sceneBaked) {
+            SceneFrame cached = sceneMgr.frame(), direct = cached;
+            cached.crossfade = direct.crossfade = 0;
+            direct.cached = false;
+            int before = rec.measure([&]() { sceneMgr.drawBackground(direct, rec); }).calls;
+            int after = rec.measure([&]() { rec.background(cached); }).calls;
+            TraceLog(LOG_INFO, "SCENE: %s background: %d draw calls per frame before caching, %d after", sceneMgr.getSceneName(), before, after);
+        }
+        if (roadBaked) {
+            Color rc = sceneMgr.getRoadColor(), lc = sceneMgr.getLineColor();
+            int before = rec.measure([&]() { road.drawDirect(rec, roadOffset, rc, lc); }).calls;
+            int after = rec.measure([&]() { rec.road(roadOffset, rc, lc); }).calls;
+            TraceLog(LOG_INFO, "ROAD: %d draw calls per frame before caching, %d after", before, after);
         }
     }
-    void updateParticles() {
-        for (auto &p : particles) {
-            p.pos.x += p.vel.x; p.pos.y += p.vel.y; p.vel.y += 0.15f;
-            p.life -= 0.02f; p.size -= 0.02f;
+
+    // One gameplay frame: the world pass (scene, road, traffic, player,
+    // particles), then the HUD. Reads game state only; safe on the update
+    // job once the graph has finished.
+    void recordGameplay(DrawList &dl) {
+        dl.clear();
+        dl.beginWorld(shakeDuration > 0 ? shakeOffset : (Vector2){0, 0});
+        dl.sceneBackground();
+        dl.road(roadOffset, sceneMgr.getRoadColor(), sceneMgr.getLineColor());
+        enemyMgr.draw(dl);
+        powerUpMgr.draw(dl);
+        if (invincibilityTimer <= 0 || (frameCount % 12 < 6)) dl.carSprites(&player, 1);
+        if (hasShield() && frameCount % 20 < 10) {
+            dl.circle(player.getPos().x, player.getPos().y, 60, SKYBLUE, true);
+            dl.circle(player.getPos().x, player.getPos().y, 65, Fade(SKYBLUE,0.5f), true);
         }
-        particles.erase(remove_if(particles.begin(), particles.end(), [](const Particle &p){ return p.life <= 0 || p.size <= 0; }), particles.end());
+        dl.particles(particles);
+        dl.endWorld();
+        drawUI(dl);
     }
-    void drawParticles() const { for (auto &p : particles) DrawCircleV(p.pos, p.size, Fade(p.col, p.life)); }
 
-    void drawRoad() {
-        Color roadColor = sceneMgr.getRoadColor();
-        DrawRectangleGradientV(ROAD_X, 0, ROAD_WIDTH, SCREEN_HEIGHT, roadColor, Fade(roadColor, 0.7f));
-        const float dashH = 30.0f, gapH = 22.0f;
-        const float pattern = dashH + gapH;
-        float offset = fmodf(roadOffset, pattern);
-        if (offset < 0) offset += pattern;
-        for (int lane = 1; lane < NUM_LANES; ++lane) {
-            float x = ROAD_X + (lane * LANE_WIDTH);
-            for (float y = -pattern; y < SCREEN_HEIGHT + pattern; y += pattern) {
-                float yPos = y + offset;
-                DrawRectangle((int)(x-4), (int)yPos, 8, (int)dashH, sceneMgr.getLineColor());
-                DrawRectangle((int)(x-3), (int)(yPos+1), 6, (int)(dashH-2), Fade(WHITE, 0.5f));
-            }
+    // Main thread, before the graph runs.
+    void beginUpdate() {
+        int desiredLevel = 1 + (scoreMgr.getCurrent() / LEVEL_SCORE_INTERVAL);
+        if (desiredLevel > MAX_LEVEL) desiredLevel = MAX_LEVEL;
+        updateLevelUp = false;
+        if (desiredLevel != enemyMgr.getLevel()) {
+            enemyMgr.setLevel(desiredLevel);
+            if (hasSfxEngine) PlaySound(sfxEngine);
+            updateLevelUp = true;
+        }
+        updateSceneBefore = sceneMgr.getCurrentScene();
+    }
+
+    // Main thread, after the graph has run.
+    void endUpdate() {
+        if (pendingSfxHit && hasSfxHit) PlaySound(sfxHit);
+        if (pendingSfxPowerup && hasSfxPowerup) PlaySound(sfxPowerup);
+        pendingSfxHit = pendingSfxPowerup = false;
+
+        // Scripts only ever resume on the main thread, outside the graph
+        if (updateLevelUp) scripts.raise(SIGNAL_LEVEL_UP);
+        if (sceneMgr.getCurrentScene() != updateSceneBefore) {
+            runScenes |= (uint8_t)(1u << sceneMgr.getCurrentScene());
+            scripts.raise(SIGNAL_SCENE_CHANGE);
         }
-        DrawRectangleGradientH(ROAD_X - 20, 0, 20, SCREEN_HEIGHT, BLACK, roadColor);
-        DrawRectangleGradientH(ROAD_X + ROAD_WIDTH, 0, 20, SCREEN_HEIGHT, roadColor, BLACK);
-        DrawRectangle(ROAD_X - 5, 0, 5, SCREEN_HEIGHT, WHITE);
-        DrawRectangle(ROAD_X + ROAD_WIDTH, 0, 5, SCREEN_HEIGHT, WHITE);
+        if (pendingPlayerHit) { pendingPlayerHit = false; scripts.raise(SIGNAL_PLAYER_HIT); }
+
+        frameCount++;
         roadOffset += 6.0f;
-        if (roadOffset > 1e6) roadOffset = fmodf(roadOffset, pattern);
+        if (roadOffset > 1e6) roadOffset = fmodf(roadOffset, RoadRenderer::PERIOD);
+        if (frameCount % 25 == 0) scoreMgr.addScore(10);
+        if (frameCount % 350 == 0) { scoreMgr.addScore(150); }
+
+        updateAudio();
+    }
+
+    // Waits for the pipelined update; its list becomes the front one.
+    void joinUpdate() {
+        if (!updateJob.valid()) return;
+        Future<Unit> job = updateJob;
+        updateJob = Future<Unit>();
+        job.get();      // rethrows a task's exception, as the serial run does
+        frontList ^= 1;
+        endUpdate();
+    }
+
+    void launchUpdate() {
+        DrawList *back = &drawLists[frontList ^ 1];
+        updateJob = jobQueue.submit([this, back]() {
+            updateGraph.run(jobQueue);
+            recordGameplay(*back);
+            return Unit();
+        });
     }
 
-    void drawUI() {
-        DrawRectangleGradientV(0, 0, SCREEN_WIDTH, 80, Fade(BLACK, 0.85f), Fade(BLACK, 0.6f));
-        DrawText(TextFormat("SCORE: %d", scoreMgr.getCurrent()), 25, 15, 28, Fade(YELLOW, 0.45f));
-        DrawText(TextFormat("SCORE: %d", scoreMgr.getCurrent()), 23, 13, 28, YELLOW);
-        DrawText(TextFormat("BEST: %d", scoreMgr.getHigh()), 25, 45, 20, GOLD);
-        DrawText("LIVES:", SCREEN_WIDTH - 270, 20, 22, WHITE);
+    void applyQuality() {
+        const QualityTier &t = quality.tier();
+        sceneMgr.setWeatherDetail(t.weather);
+        sceneMgr.setSkylineDepths(t.skylineDepths);
+        particles.setLimit((int)(ParticleSystem::CAPACITY * t.particles));
+        if (world.isAuto()) world.setStep(quality.scaleStep());
+    }
+
+    static bool isFrozenState(GameState s) { return s == PAUSED || s == GAME_OVER || s == SCORES; }
+
+    // What the frozen screens show behind their overlay: the last gameplay
+    // frame, or the scene backdrop when coming from the menu.
+    void drawFrozenSource() {
+        RaylibRenderer r = screen(nullptr);     // straight into the frozen texture, unshaken
+        if (liveState != PLAYING || !frontValid) { sceneMgr.drawBackground(r); return; }
+        drawLists[frontList].submit(r);
+    }
+
+    // Once per entry into a frozen state; call outside BeginDrawing.
+    void freezeFrame() {
+        if (frozen.id == 0 && !frozenFailed) {
+            frozen = LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT);
+            if (frozen.id == 0) {
+                TraceLog(LOG_WARNING, "RENDER: No render texture for frozen screens; redrawing them every frame");
+                frozenFailed = true;
+            }
+        }
+        if (frozenFailed) return;
+        BeginTextureMode(frozen);
+        ClearBackground(RAYWHITE);
+        beginOpaqueBake();
+        drawFrozenSource();
+        EndBlendMode();
+        EndTextureMode();
+        frozenValid = true;
+    }
+
+    void drawFrozen() {
+        if (frozenValid) drawRenderTexture(frozen, 0, 0);
+        else drawFrozenSource();
+    }
+
+    // Drops to IDLE_FPS while a frozen screen sits without input.
+    void updateIdleMode() {
+        Vector2 md = GetMouseDelta();
+        bool input = GetKeyPressed() != 0 || IsMouseButtonPressed(MOUSE_LEFT_BUTTON) || md.x != 0 || md.y != 0;
+        if (!isFrozenState(state) || input || statusTimer > 0) idleSince = GetTime();
+        bool idle = GetTime() - idleSince > IDLE_AFTER_SECONDS;
+        if (idle == idleMode) return;
+        idleMode = idle;
+        SetTargetFPS(idle ? IDLE_FPS : FRAME_RATE);
+        TraceLog(LOG_INFO, "RENDER: %s idle mode (%d FPS)", idle ? "Entering" : "Leaving", idle ? IDLE_FPS : FRAME_RATE);
+    }
+
+    void drawUI(DrawList &dl) {
+        dl.rectangleGradientV(0, 0, SCREEN_WIDTH, 80, Fade(BLACK, 0.85f), Fade(BLACK, 0.6f));
+        dl.textf(25, 15, 28, Fade(YELLOW, 0.45f), "SCORE: %d", scoreMgr.getCurrent());
+        dl.textf(23, 13, 28, YELLOW, "SCORE: %d", scoreMgr.getCurrent());
+        dl.textf(25, 45, 20, GOLD, "BEST: %d", scoreMgr.getHigh());
+        dl.text("LIVES:", SCREEN_WIDTH - 270, 20, 22, WHITE);
         for (int i=0;i<3;i++){
-            if (i < lives) { DrawCircle(SCREEN_WIDTH - 180 + (i*45), 35, 16, RED); DrawCircle(SCREEN_WIDTH - 180 + (i*45), 35, 12, Fade(PINK, 0.7f)); }
-            else DrawCircleLines(SCREEN_WIDTH - 180 + (i*45), 35, 16, DARKGRAY);
+            if (i < lives) { dl.circle(SCREEN_WIDTH - 180 + (i*45), 35, 16, RED); dl.circle(SCREEN_WIDTH - 180 + (i*45), 35, 12, Fade(PINK, 0.7f)); }
+            else dl.circle(SCREEN_WIDTH - 180 + (i*45), 35, 16, DARKGRAY, true);
         }
-        DrawText(TextFormat("LEVEL %d", enemyMgr.getLevel()), 350, 20, 25, LIME);
-        if (scoreMgr.getStreak() > 5) DrawText(TextFormat("STREAK x%d", scoreMgr.getStreak()), 550, 20, 22, ORANGE);
-        DrawText(sceneMgr.getSceneName(), (int)(SCREEN_WIDTH * 0.5f) - 50, 50, 20, Fade(WHITE, 0.7f));
+        dl.textf(350, 20, 25, LIME, "LEVEL %d", enemyMgr.getLevel());
+        if (scoreMgr.getStreak() > 5) dl.textf(550, 20, 22, ORANGE, "STREAK x%d", scoreMgr.getStreak());
+        dl.text(sceneMgr.getSceneName(), (int)(SCREEN_WIDTH * 0.5f) - 50, 50, 20, Fade(WHITE, 0.7f));
         int px = 20;
         for (size_t i=0;i<activePowerUps.size();i++){
             const char* txt = ""; Color c = WHITE;
             switch(activePowerUps[i].type){ case SHIELD: txt="SHIELD"; c = SKYBLUE; break; case SLOW_MOTION: txt="SLOW-MO"; c = PURPLE; break; case SCORE_MULTIPLIER: txt="2X SCORE"; c = GOLD; break; default: break; }
             Rectangle r = {(float)px, (float)SCREEN_HEIGHT - 50, 110, 35};
-            DrawRectangleRounded(r, 0.3f, 6, Fade(c, 0.6f));
-            DrawRectangleRoundedLines(r, 0.3f, 6, c);
-            DrawText(txt, px + 12, SCREEN_HEIGHT - 43, 18, WHITE);
+            dl.rectangleRounded(r, 0.3f, 6, Fade(c, 0.6f));
+            dl.rectangleRounded(r, 0.3f, 6, c, true);
+            dl.text(txt, px + 12, SCREEN_HEIGHT - 43, 18, WHITE);
             float prog = activePowerUps[i].timeRemaining / 300.0f;
             Rectangle pr = {(float)px + 5, (float)SCREEN_HEIGHT - 20, 100 * prog, 6};
-            if (prog > 0.0001f) DrawRectangleRounded(pr, 0.5f, 4, c);
+            if (prog > 0.0001f) dl.rectangleRounded(pr, 0.5f, 4, c);
             px += 120;
         }
-        DrawRectangle(0, SCREEN_HEIGHT - 35, SCREEN_WIDTH, 35, Fade(BLACK, 0.7f));
-        DrawText("Arrow Keys or A/D: Move |  Q: Quit", (int)(SCREEN_WIDTH * 0.5f) - 250, SCREEN_HEIGHT - 25, 18, LIGHTGRAY);
+        dl.rectangle(0, SCREEN_HEIGHT - 35, SCREEN_WIDTH, 35, Fade(BLACK, 0.7f));
+        dl.text("Arrow Keys or A/D: Move |  Q: Quit", (int)(SCREEN_WIDTH * 0.5f) - 250, SCREEN_HEIGHT - 25, 18, LIGHTGRAY);
     }
 
     void getMenuRects(Rectangle out[3], int sel){
@@ -936,14 +5101,16 @@ private:
                         for (size_t k=0;k<activePowerUps.size();k++){
                             if (activePowerUps[k].type == SHIELD) { activePowerUps.erase(activePowerUps.begin() + k); break; }
                         }
-                        createParticles(player.getPos().x, player.getPos().y, SKYBLUE, 30);
+                        particles.emit(EFFECT_SHIELD_HIT, player.getPos().x, player.getPos().y);
                         triggerShake(8.0f, 15.0f);
-                        if (hasSfxHit) PlaySound(sfxHit);
+                        pendingSfxHit = true;
+                        runCollisions++;
                     } else {
-                        lives--; scoreMgr.resetStreak(); createParticles(player.getPos().x, player.getPos().y, RED, 40);
+                        lives--; pendingPlayerHit = true; scoreMgr.resetStreak(); particles.emit(EFFECT_CRASH, player.getPos().x, player.getPos().y);
                         triggerShake(15.0f, 30.0f);
-                        if (hasSfxHit) PlaySound(sfxHit);
-                        if (lives <= 0) { state = GAME_OVER; scoreMgr.saveScoreAsync(jobQueue); }
+                        pendingSfxHit = true;
+                        runCollisions++;
+                        if (lives <= 0) { state = GAME_OVER; finishRun(); }
                     }
                     invincibilityTimer = 80.0f;
                     break;
@@ -957,9 +5124,9 @@ private:
                 if (!pu->isCollected() && pbox.checkCollision(pu->box())) {
                     PowerUpType t = pu->getType();
                     pu->setCollected(true);
-                    createParticles(pu->getPos().x, pu->getPos().y, GOLD, 28);
+                    particles.emit(EFFECT_PICKUP, pu->getPos().x, pu->getPos().y);
                     triggerShake(3.0f, 8.0f);
-                    if (hasSfxPowerup) PlaySound(sfxPowerup);
+                    pendingSfxPowerup = true;
                     switch(t) {
                         case SHIELD: activePowerUps.push_back(ActivePowerUp(SHIELD, 350)); break;
                         case SLOW_MOTION: activePowerUps.push_back(ActivePowerUp(SLOW_MOTION, 250)); break;
@@ -981,6 +5148,51 @@ private:
         }
     }
 
+    RunInfo currentRun() const { return RunInfo{ (int64_t)time(NULL), enemyMgr.getLevel(), sceneMgr.getCurrentScene(), runSeed, (uint32_t)frameCount }; }
+
+    void saveScores(const RunInfo &run) {
+        scoreMgr.saveScoreAsync(jobQueue, run).onError(dispatcher, [this](const string &err) {
+            showStatus("SAVE FAILED: " + err);
+        });
+    }
+
+    // Called once a run is over (game over or quit): saves the top scores and
+    // appends the run to the history log.
+    void finishRun() {
+        if (!persistRuns) { runActive = false; return; }
+        RunInfo run = currentRun();
+        saveScores(run);
+        if (!runActive) return;
+        runActive = false;
+        RunRecord r;
+        memset(&r, 0, sizeof(r));
+        r.timestamp = run.timestamp;
+        r.score = scoreMgr.getCurrent();
+        r.maxStreak = scoreMgr.getMaxStreak();
+        r.frames = (uint32_t)frameCount;
+        r.seed = runSeed;
+        r.build = BUILD_ID;
+        r.level = (uint16_t)enemyMgr.getLevel();
+        r.collisions = (uint16_t)min(runCollisions, 0xFFFF);
+        r.scenes = runScenes;
+        r.finalScene = (uint8_t)sceneMgr.getCurrentScene();
+        history.append(r);
+        scoreMgr.shareRun(jobQueue, r);
+    }
+
+    void showStatus(const string &text) {
+        statusText = text;
+        statusTimer = 4.0f * FRAMES_PER_SEC;
+    }
+
+    void drawStatus() {
+        if (statusTimer <= 0) return;
+        statusTimer -= 1.0f;
+        int tw = MeasureText(statusText.c_str(), 20);
+        DrawRectangle((SCREEN_WIDTH - tw) / 2 - 12, 90, tw + 24, 32, Fade(BLACK, 0.75f));
+        DrawText(statusText.c_str(), (SCREEN_WIDTH - tw) / 2, 96, 20, ORANGE);
+    }
+
     void handleInput() {
         int newLane = currentLane;
         if ((IsKeyPressed(KEY_LEFT) || IsKeyPressed(KEY_A)) && currentLane > 0) newLane--;
@@ -992,11 +5204,11 @@ private:
             player.setLane(currentLane);
         }
         if (IsKeyPressed(KEY_ESCAPE)) state = PAUSED;
-        if (IsKeyPressed(KEY_Q)) { state = MENU; scoreMgr.saveScoreAsync(jobQueue); }
+        if (IsKeyPressed(KEY_Q)) { state = MENU; finishRun(); }
     }
 
+    // Overlay only; the scene behind it is drawn as part of the world.
     void drawMenu() {
-        sceneMgr.drawBackground();
         DrawText("TRAFFIC RACER", (int)(SCREEN_WIDTH * 0.5f) - 250, 100, 70, Fade(YELLOW, 0.5f));
         DrawText("TRAFFIC RACER", (int)(SCREEN_WIDTH * 0.5f) - 253, 97, 70, YELLOW);
         DrawText("DSA PROJECT", (int)(SCREEN_WIDTH * 0.5f) - 110, 180, 30, GOLD);
@@ -1013,17 +5225,43 @@ private:
         DrawText("Features: 8 Dynamic Scenes | Camera Shake | Smooth Slow Motion", (int)(SCREEN_WIDTH * 0.5f) - 310, SCREEN_HEIGHT - 60, 18, DARKGRAY);
     }
 
+    // Asks the shared daemon for the board the scores screen is showing.
+    void requestSharedTop() {
+        if (!scoresShared) return;
+        uint32_t gen = ++sharedTopGen;
+        sharedTopStatus = "LOADING...";
+        LeaderboardFilter f;
+        f.scene = scoresFilter;
+        scoreMgr.sharedBoard().fetchTop(jobQueue, 8, f).then(dispatcher, [this, gen](const vector<ScoreRecord> &top) {
+            if (gen != sharedTopGen) return;
+            sharedTop = top;
+            sharedTopStatus.clear();
+        }).onError(dispatcher, [this, gen](const string &) {
+            if (gen == sharedTopGen) sharedTopStatus = TextFormat("OFFLINE (%d runs cached)", (int)scoreMgr.sharedBoard().pendingCount());
+        });
+    }
+
+    // Overlay only; the backdrop is the frozen frame.
     void drawScoresScreen() {
-        sceneMgr.drawBackground();
         Rectangle stats = {150, 180, SCREEN_WIDTH - 300, 350};
         DrawRectangleRounded(stats, 0.2f, 6, Fade(BLACK, 0.8f));
         DrawRectangleRoundedLines(stats, 0.2f, 6, GOLD);
-        DrawText("TOP SCORES", (int)(SCREEN_WIDTH * 0.5f) - 80, 200, 40, YELLOW);
-        const vector<int> ts = scoreMgr.getTopScores();
-        for (size_t i=0;i<min((size_t)8, ts.size()); ++i) {
-            DrawText(TextFormat("%d. %d", (int)i+1, ts[i]), 260, 260 + (int)i * 30, 26, WHITE);
+        DrawText(scoresShared ? "SHARED SCORES" : "TOP SCORES", (int)(SCREEN_WIDTH * 0.5f) - (scoresShared ? 130 : 80), 200, 40, YELLOW);
+        LeaderboardFilter f;
+        f.scene = scoresFilter;
+        static const vector<ScoreRecord> none;
+        const vector<ScoreRecord> &ts = !scoresShared ? scoreMgr.topView(8, f) : sharedTopStatus.empty() ? sharedTop : none;
+        uint32_t runs = scoresShared ? scoreMgr.sharedBoard().sharedTotal() : scoreMgr.getLeaderboard().count(f);
+        const char *filterName = scoresFilter < 0 ? "ALL SCENES" : SceneManager::sceneName((SceneType)scoresFilter);
+        DrawText(TextFormat("< %s >  %u runs", filterName, runs), SCREEN_WIDTH - 460, 210, 22, LIGHTGRAY);
+        if (scoresShared && !sharedTopStatus.empty()) DrawText(sharedTopStatus.c_str(), 260, 260, 24, LIGHTGRAY);
+        else if (!scoresShared && !scoreMgr.isLoaded()) DrawText("LOADING SCORES...", 260, 260, 24, LIGHTGRAY);
+        for (size_t i=0;i<ts.size(); ++i) {
+            DrawText(TextFormat("%d. %d", (int)i+1, ts[i].score), 260, 260 + (int)i * 30, 26, WHITE);
+            if (ts[i].level > 0) DrawText(TextFormat("LEVEL %d", (int)ts[i].level), 520, 264 + (int)i * 30, 20, SKYBLUE);
+            if (ts[i].scene < NUM_SCENES) DrawText(SceneManager::sceneName((SceneType)ts[i].scene), 680, 264 + (int)i * 30, 20, GOLD);
         }
-        DrawText("Press ENTER or ESC to return", (int)(SCREEN_WIDTH * 0.5f) - 160, SCREEN_HEIGHT - 80, 22, LIGHTGRAY);
+        DrawText("LEFT/RIGHT filter by scene, TAB local/shared, ENTER or ESC to return", (int)(SCREEN_WIDTH * 0.5f) - 360, SCREEN_HEIGHT - 80, 22, LIGHTGRAY);
     }
 
     void drawPauseScreen() {
@@ -1033,8 +5271,8 @@ private:
         DrawText("Press Q to Quit to Menu", (int)(SCREEN_WIDTH * 0.5f) - 150, SCREEN_HEIGHT/2 + 40, 22, WHITE);
     }
 
+    // Overlay only; the backdrop is the frozen frame.
     void drawGameOver() {
-        sceneMgr.drawBackground();
         DrawText("GAME OVER", (int)(SCREEN_WIDTH * 0.5f) - 200, 80, 60, RED);
         Rectangle statsBox = {150, 180, SCREEN_WIDTH - 300, 350};
         DrawRectangleRounded(statsBox, 0.2f, 6, Fade(BLACK, 0.85f));
@@ -1044,26 +5282,43 @@ private:
         DrawText(TextFormat("High Score: %d", scoreMgr.getHigh()), 200, 310, 25, GOLD);
         DrawText(TextFormat("Max Streak: %d", scoreMgr.getMaxStreak()), 200, 350, 25, ORANGE);
         DrawText(TextFormat("Level Reached: %d", enemyMgr.getLevel()), 200, 390, 25, SKYBLUE);
+        const RunStanding &st = scoreMgr.getLastStanding();
+        // Until the history lands, the standing only covers this session's runs
+        if (!scoreMgr.isLoaded()) {
+            DrawText("Rank: loading history...", 200, 430, 25, PURPLE);
+            DrawText(TextFormat("Survived %.1fs", frameCount / (float)FRAMES_PER_SEC), 200, 495, 18, LIGHTGRAY);
+        } else {
+            DrawText(TextFormat("Rank: #%u of %u", st.rank, scoreMgr.getLeaderboard().count()), 200, 430, 25, PURPLE);
+            DrawText(TextFormat("You beat %.0f%% of runs", st.scoreBeaten), 200, 465, 22, LIGHTGRAY);
+            DrawText(TextFormat("Survived %.1fs, longer than %.0f%% of level %d runs (median %.1fs, p90 %.1fs)",
+                                frameCount / (float)FRAMES_PER_SEC, st.survivalBeaten, enemyMgr.getLevel(), st.levelMedianSec, st.levelP90Sec),
+                     200, 495, 18, LIGHTGRAY);
+        }
         DrawText("TOP 5 SCORES", 500, 270, 25, PURPLE);
-        const vector<int> s = scoreMgr.getTopScores();
-        for (size_t i=0;i<min((size_t)5, s.size()); ++i) DrawText(TextFormat("%d. %d", (int)i+1, s[i]), 520, 310 + (int)i * 30, 20, WHITE);
+        const vector<ScoreRecord> &s = scoreMgr.topView(5);
+        for (size_t i=0;i<s.size(); ++i) DrawText(TextFormat("%d. %d", (int)i+1, s[i].score), 520, 310 + (int)i * 30, 20, WHITE);
         DrawText("Press ENTER to return to menu", (int)(SCREEN_WIDTH * 0.5f) - 200, SCREEN_HEIGHT - 80, 22, LIGHTGRAY);
     }
 
     void resetGame() {
         lives = 3; currentLane = 2; roadOffset = 0; frameCount = 0; invincibilityTimer = 0;
+        runSeed = (uint32_t)time(NULL) ^ ((uint32_t)rand() << 8);
+        srand(runSeed);
         shakeIntensity = 0; shakeDuration = 0; shakeOffset = {0, 0};
         float sx = laneCenterX(currentLane);
         player.setPos(sx, SCREEN_HEIGHT - 150); player.setTarget(sx, SCREEN_HEIGHT - 150);
         enemyMgr.reset(); powerUpMgr.reset(); scoreMgr.reset(); activePowerUps.clear(); particles.clear();
-        sceneMgr = SceneManager();
+        sceneMgr.reset();
+        frontValid = false;
+        runActive = true; runCollisions = 0; runScenes = (uint8_t)(1u << sceneMgr.getCurrentScene());
 
         scheduler.clear();
+        scripts.clear();
         if (qtRoot) { delete qtRoot; qtRoot = nullptr; }
         qtRoot = new Quadtree({0,0,(float)SCREEN_WIDTH,(float)SCREEN_HEIGHT}, 8);
 
-        scheduleEnemySpawn(frameCount + 20);
-        schedulePowerupSpawn(frameCount + 350);
+        scripts.start(enemyTraffic(), frameCount + 20);
+        scripts.start(powerupDrops(), frameCount + 350);
 
         if (hasMusic) {
             StopMusicStream(bgMusic);
@@ -1084,25 +5339,37 @@ private:
         const char *powerPath   = "src/assets/powerup.wav";
         const char *enginePath  = "src/assets/engine.wav";
 
+        // Decoded on the pool; each has* flag flips once the upload lands,
+        // until then the sound is simply silent.
+        auto logFailure = [](const string &err) { TraceLog(LOG_WARNING, "AUDIO: %s", err.c_str()); };
+
         if (FileExists(musicPath)) {
-            bgMusic = LoadMusicStream(musicPath);
-            PlayMusicStream(bgMusic);
-            hasMusic = true;
+            streamer.requestMusic(musicPath).then(dispatcher, [this](const Music &m) {
+                bgMusic = m;
+                PlayMusicStream(bgMusic);
+                hasMusic = true;
+            }).onError(dispatcher, logFailure);
         }
 
         if (FileExists(hitPath)) {
-            sfxHit = LoadSound(hitPath);
-            hasSfxHit = true;
+            streamer.requestSound(hitPath).then(dispatcher, [this](const Sound &snd) {
+                sfxHit = snd;
+                hasSfxHit = true;
+            }).onError(dispatcher, logFailure);
         }
 
         if (FileExists(powerPath)) {
-            sfxPowerup = LoadSound(powerPath);
-            hasSfxPowerup = true;
+            streamer.requestSound(powerPath).then(dispatcher, [this](const Sound &snd) {
+                sfxPowerup = snd;
+                hasSfxPowerup = true;
+            }).onError(dispatcher, logFailure);
         }
 
         if (FileExists(enginePath)) {
-            sfxEngine = LoadSound(enginePath);
-            hasSfxEngine = true;
+            streamer.requestSound(enginePath).then(dispatcher, [this](const Sound &snd) {
+                sfxEngine = snd;
+                hasSfxEngine = true;
+            }).onError(dispatcher, logFailure);
         }
     }
 
@@ -1112,45 +5379,81 @@ private:
     }
 
     void unloadAudio() {
+        if (hasMusic) { StopMusicStream(bgMusic); hasMusic = false; }
+        hasSfxHit = hasSfxPowerup = hasSfxEngine = false;
+        streamer.unloadAll(); // owns the streamed sounds and music
         if (!audioDeviceReady) return;
-        if (hasMusic) { StopMusicStream(bgMusic); UnloadMusicStream(bgMusic); hasMusic = false; }
-        if (hasSfxHit) { StopSound(sfxHit); UnloadSound(sfxHit); hasSfxHit = false; }
-        if (hasSfxPowerup) { StopSound(sfxPowerup); UnloadSound(sfxPowerup); hasSfxPowerup = false; }
-        if (hasSfxEngine) { StopSound(sfxEngine); UnloadSound(sfxEngine); hasSfxEngine = false; }
         CloseAudioDevice();
         audioDeviceReady = false;
     }
 
-    void scheduleEnemySpawn(uint64_t atTick) {
-        scheduler.scheduleAt(atTick, [this, atTick]() {
+    void rebuildBroadphase() {
+        if (qtRoot) { qtRoot->clear(); }
+        else qtRoot = new Quadtree({0,0,(float)SCREEN_WIDTH,(float)SCREEN_HEIGHT}, 8);
+
+        for (auto &e : enemyMgr.getEnemies()) {
+            QTItem it; it.box = e.box(); it.ref = (void*)&e; it.type = 1;
+            qtRoot->insert(it);
+        }
+        for (auto &p : powerUpMgr.getPowerUps()) {
+            QTItem it; it.box = p.box(); it.ref = (void*)&p; it.type = 2;
+            qtRoot->insert(it);
+        }
+    }
+
+    // Declaration order is the original serial order; the graph only
+    // overlaps phases whose read/write sets do not conflict.
+    void buildUpdateGraph() {
+        updateGraph.add("scene", 0, RES_SCENE, [this]{ sceneMgr.update(); });
+        updateGraph.add("player", 0, RES_PLAYER, [this]{ player.update(); });
+        updateGraph.add("camera", 0, RES_CAMERA | RES_RNG, [this]{ updateCameraShake(); });
+        updateGraph.add("enemies", RES_ACTIVE_POWERUPS, RES_ENEMIES,
+                        [this]{ enemyMgr.update(hasSlowMotion(), &jobQueue); });
+        updateGraph.add("powerups", 0, RES_POWERUPS, [this]{ powerUpMgr.update(); });
+        updateGraph.add("broadphase", RES_ENEMIES | RES_POWERUPS, RES_BROADPHASE, [this]{ rebuildBroadphase(); });
+        updateGraph.add("collisions", RES_BROADPHASE | RES_ENEMIES | RES_SCENE,
+                        RES_PLAYER | RES_POWERUPS | RES_ACTIVE_POWERUPS | RES_SCORE | RES_LIVES |
+                        RES_PARTICLES | RES_CAMERA | RES_AUDIO | RES_RNG,
+                        [this]{ checkCollisions(); });
+        updateGraph.add("active-powerups", 0, RES_ACTIVE_POWERUPS | RES_SCORE, [this]{ updatePowerUps(); });
+        updateGraph.add("particles", 0, RES_PARTICLES, [this]{ updateParticles(); });
+    }
+
+    // Base traffic: one car per interval, the interval shrinking with level.
+    SpawnScript enemyTraffic() {
+        for (;;) {
             int chosen = enemyMgr.chooseSafeLane();
             if (chosen != -1) enemyMgr.spawnAtLane(chosen);
-            float spawnBase = 85.0f - enemyMgr.getLevel() * 0.65f;
-            float spawn = std::max(7.0f, spawnBase + (rand()%20 - 10));
-            uint64_t frames = (uint64_t)std::max(7.0f, spawn);
-            scheduleEnemySpawn(atTick + frames);
-        });
+            co_await scripts.frames((uint64_t)EnemyManager::trafficInterval(enemyMgr.getLevel()));
+        }
     }
 
-    void schedulePowerupSpawn(uint64_t atTick) {
-        scheduler.scheduleAt(atTick, [this, atTick]() {
+    SpawnScript powerupDrops() {
+        for (;;) {
             int lane = powerUpMgr.chooseFreeLaneBasedOnEnemies(enemyMgr);
             if (lane != -1) powerUpMgr.spawnAtLane(lane);
-            uint64_t next = 500 + (rand()%300);
-            schedulePowerupSpawn(atTick + next);
-        });
+            co_await scripts.frames(500 + (rand()%300));
+        }
     }
 
 public:
-    TrafficRacingGame()
-        : player(ROAD_X + 60 + (2 * LANE_WIDTH), SCREEN_HEIGHT - 150, 2, 0.0f, GREEN, true),
-          state(MENU), lives(3), currentLane(2), roadOffset(0), frameCount(0), invincibilityTimer(0),
-          menuSelection(0), shakeIntensity(0), shakeDuration(0), shakeOffset({0, 0}),
+    explicit TrafficRacingGame(const GameOptions &opts = GameOptions())
+        : player(ROAD_X + 60 + (2 * LANE_WIDTH), SCREEN_HEIGHT - 150, 2, 0.0f, PLAYER_CAR_COLOR, true),
+          scoreMgr("traffic_scores.dat", opts.leaderboardSocket), state(MENU), lives(3), currentLane(2), roadOffset(0), frameCount(0), invincibilityTimer(0),
+          menuSelection(0), scoresFilter(-1), scoresShared(false), sharedTopGen(0), runSeed(0), runActive(false), runCollisions(0), runScenes(0), shakeIntensity(0), shakeDuration(0), shakeOffset({0, 0}),
           audioDeviceReady(false), hasMusic(false), hasSfxHit(false), hasSfxPowerup(false), hasSfxEngine(false),
-          qtRoot(nullptr)
+          qtRoot(nullptr), scripts(scheduler), streamer(jobQueue, opts.uploadBudgetMs), pendingSfxHit(false), pendingSfxPowerup(false), pendingPlayerHit(false),
+          updateLevelUp(false), updateSceneBefore(CITY), frontList(0), frontValid(false), pipelineEnabled(opts.pipeline), persistRuns(true), statusTimer(0),
+          frozen(), frozenValid(false), frozenFailed(false), liveState(MENU), idleSince(0), idleMode(false)
     {
         srand((unsigned)time(NULL));
         qtRoot = new Quadtree({0,0,(float)SCREEN_WIDTH,(float)SCREEN_HEIGHT}, 8);
+        sceneMgr.setWeatherDensity(opts.weatherDensity);
+        world.configure(opts.renderScale, opts.autoRenderScale);
+        quality.configure(opts.qualityTier, opts.autoQuality, world.isAuto());
+        applyQuality();
+        sceneMgr.enablePrefetch(jobQueue, dispatcher);
+        buildUpdateGraph();
     }
 
     ~TrafficRacingGame() {
@@ -1160,14 +5463,35 @@ public:
 
     void run() {
         InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Traffic Racer - DSA Upgraded");
+        TraceLog(LOG_INFO, "STARTUP: Window created after %.1f ms", msSinceStart());
         SetTargetFPS(FRAME_RATE);
         initAudio();
-        sceneMgr.loadTextures(); // Load background textures
+        RaylibRenderer layers = screen(nullptr);    // bakes, and the menu's backdrop inside the world pass
+        carAtlas.bake(layers);
+        history.open(jobQueue);      // Queues recovery/compaction left over from last session
+        // Score file, history ranking and shared cache load behind the menu
+        scoreMgr.loadAsync(jobQueue, dispatcher, history).then(dispatcher, [](const Unit&) {
+            TraceLog(LOG_INFO, "STARTUP: Scores ready after %.1f ms", msSinceStart());
+        }).onError(dispatcher, [](const string &err) {
+            TraceLog(LOG_WARNING, "SCORES: Load failed: %s", err.c_str());
+        });
 
         bool running = true;
+        bool firstFrame = true, assetsReported = false;
         while (running && !WindowShouldClose()) {
+            joinUpdate();
+            // Idle frames are slow on purpose, and frozen ones redraw no world
+            if (!firstFrame && !idleMode && !isFrozenState(state) && quality.observe(GetFrameTime())) applyQuality();
+            streamer.pump();
+            dispatcher.drain();
+            scoreMgr.pumpShared(jobQueue);
+            if (!assetsReported && streamer.pending() == 0) {
+                TraceLog(LOG_INFO, "STARTUP: All assets resident after %.1f ms", msSinceStart());
+                assetsReported = true;
+            }
             scheduler.process(frameCount);
 
+            bool pipelined = false;
             switch (state) {
                 case MENU: {
                     sceneMgr.update();
@@ -1180,62 +5504,36 @@ public:
                             if (CheckCollisionPointRec(mp, mr[i])) {
                                 menuSelection = i;
                                 if (i==0) { resetGame(); state = PLAYING; }
-                                else if (i==1) { state = SCORES; }
+                                else if (i==1) { state = SCORES; requestSharedTop(); }
                                 else if (i==2) { running = false; }
                             }
                         }
                     }
                     if (IsKeyPressed(KEY_ENTER)) {
                         if (menuSelection == 0) { resetGame(); state = PLAYING; }
-                        else if (menuSelection == 1) state = SCORES;
+                        else if (menuSelection == 1) { state = SCORES; requestSharedTop(); }
                         else if (menuSelection == 2) running = false;
                     }
                 } break;
 
                 case PLAYING: {
                     handleInput();
-                    sceneMgr.update();
-                    player.update();
-                    updateCameraShake();
-
-                    int desiredLevel = 1 + (scoreMgr.getCurrent() / LEVEL_SCORE_INTERVAL);
-                    if (desiredLevel > MAX_LEVEL) desiredLevel = MAX_LEVEL;
-                    if (desiredLevel != enemyMgr.getLevel()) {
-                        enemyMgr.setLevel(desiredLevel);
-                        if (hasSfxEngine) PlaySound(sfxEngine);
-                    }
-
-                    bool slow = hasSlowMotion();
-                    enemyMgr.update(slow);
-                    powerUpMgr.update();
-
-                    if (qtRoot) { qtRoot->clear(); }
-                   else qtRoot = new Quadtree({0,0,(float)SCREEN_WIDTH,(float)SCREEN_HEIGHT}, 8);
-
-                    for (auto &e : enemyMgr.getEnemies()) {
-                 
-                        QTItem it; it.box = e.box(); it.ref = (void*)&e; it.type = 1;
-                        qtRoot->insert(it);
+                    beginUpdate();
+                    // Overlapped with drawing once there is a frame to show;
+                    // confirmed below once the background layer is prepared
+                    if (pipelineEnabled && frontValid && state == PLAYING && sceneMgr.canCacheLayer()) {
+                        pipelined = true;
+                        break;
                     }
-                    for (auto &p : powerUpMgr.getPowerUps()) {
-                        QTItem it; it.box = p.box(); it.ref = (void*)&p; it.type = 2;
-                        qtRoot->insert(it);
-                    }
-
-                    checkCollisions();
-                    updatePowerUps();
-                    updateParticles();
-
-                    frameCount++;
-                    if (frameCount % 25 == 0) scoreMgr.addScore(10);
-                    if (frameCount % 350 == 0) { scoreMgr.addScore(150); }
-
-                    updateAudio();
+                    updateGraph.run(jobQueue);
+                    recordGameplay(drawLists[frontList]);
+                    frontValid = true;
+                    endUpdate();
                 } break;
 
                 case PAUSED:
                     if (IsKeyPressed(KEY_ESCAPE)) state = PLAYING;
-                    if (IsKeyPressed(KEY_Q)) { state = MENU; scoreMgr.saveScoreAsync(jobQueue); }
+                    if (IsKeyPressed(KEY_Q)) { state = MENU; finishRun(); }
                     updateAudio();
                     break;
 
@@ -1246,63 +5544,638 @@ public:
 
                 case SCORES:
                     if (IsKeyPressed(KEY_ENTER) || IsKeyPressed(KEY_ESCAPE)) state = MENU;
+                    if (IsKeyPressed(KEY_RIGHT)) { scoresFilter = scoresFilter + 1 < NUM_SCENES ? scoresFilter + 1 : -1; requestSharedTop(); }
+                    if (IsKeyPressed(KEY_LEFT)) { scoresFilter = scoresFilter > -1 ? scoresFilter - 1 : NUM_SCENES - 1; requestSharedTop(); }
+                    if (IsKeyPressed(KEY_TAB)) { scoresShared = !scoresShared; requestSharedTop(); }
                     updateAudio();
                     break;
             }
 
+            prepareLayers(layers);
+            // An uncached background is drawn from live scene state, which the
+            // update job would be writing; such frames update serially
+            if (pipelined && !sceneMgr.frame().cached) {
+                pipelined = false;
+                updateGraph.run(jobQueue);
+                recordGameplay(drawLists[frontList]);
+                endUpdate();
+            }
+            if (frontValid) drawLists[frontList].setBackground(sceneMgr.frame());
+            if (!isFrozenState(state)) { frozenValid = false; liveState = state; }
+            else if (!frozenValid) freezeFrame();
+            updateIdleMode();
+            // From here the update job may change the state; draw what was decided
+            GameState shown = state;
+            if (pipelined) launchUpdate();
             BeginDrawing();
             ClearBackground(RAYWHITE);
 
-            switch (state) {
-                case MENU: drawMenu(); break;
-                case PLAYING:
-                    if (shakeDuration > 0) {
-                        BeginMode2D(Camera2D{{0, 0}, {shakeOffset.x, shakeOffset.y}, 0, 1.0f});
-                    }
-                    
-                    sceneMgr.drawBackground();
-                    drawRoad();
-                    enemyMgr.draw();
-                    powerUpMgr.draw();
-                    if (invincibilityTimer <= 0 || (frameCount % 12 < 6)) player.draw();
-                    if (hasShield() && frameCount % 20 < 10) {
-                        DrawCircleLines(player.getPos().x, player.getPos().y, 60, SKYBLUE);
-                        DrawCircleLines(player.getPos().x, player.getPos().y, 65, Fade(SKYBLUE,0.5f));
-                    }
-                    drawParticles();
-                    
-                    if (shakeDuration > 0) {
-                        EndMode2D();
-                    }
-                    
-                    drawUI();
-                    break;
-                case PAUSED:
-                    sceneMgr.drawBackground();
-                    drawRoad();
-                    enemyMgr.draw();
-                    powerUpMgr.draw();
-                    player.draw();
-                    drawUI();
-                    drawPauseScreen();
+            switch (shown) {
+                case MENU:
+                    world.begin((Vector2){0, 0});
+                    sceneMgr.drawBackground(layers);
+                    world.end();
+                    drawMenu();
                     break;
-                case GAME_OVER: drawGameOver(); break;
-                case SCORES: drawScoresScreen(); break;
+                case PLAYING: {
+                    RaylibRenderer r = screen(&world);
+                    drawLists[frontList].submit(r);
+                } break;
+                case PAUSED: drawFrozen(); drawPauseScreen(); break;
+                case GAME_OVER: drawFrozen(); drawGameOver(); break;
+                case SCORES: drawFrozen(); drawScoresScreen(); break;
             }
+            drawStatus();
 
             EndDrawing();
+            if (firstFrame) {
+                TraceLog(LOG_INFO, "STARTUP: First frame presented after %.1f ms", msSinceStart());
+                firstFrame = false;
+            }
         }
 
-        scoreMgr.saveScoreAsync(jobQueue);
+        joinUpdate();
+        if (runActive) finishRun();
+        else scoreMgr.saveScoreAsync(jobQueue, currentRun());
+        if (!scoreMgr.flush(SHUTDOWN_FLUSH_SECONDS)) TraceLog(LOG_WARNING, "SCORES: Final save failed");
         jobQueue.shutdown();
 
         unloadAudio();
+        sceneMgr.unloadLayer(layers);
+        carAtlas.unload(layers);
+        road.unload(layers);
+        particles.unload();
+        world.unload();
+        quality.logSummary();
+        if (frozen.id != 0) UnloadRenderTexture(frozen);
         CloseWindow();
     }
+
+    // Counts (and optionally traces) what this game's frames draw.
+    RecordingRenderer recorder(ostream *trace) { return RecordingRenderer(sceneMgr, road, carAtlas, particles, trace); }
+
+    // Plays `frames` gameplay frames without a window, audio or input and
+    // submits each recorded frame to `r`. The update is serial. Layers are
+    // baked through `r` as on screen, or with `cacheLayers` off never baked,
+    // so every frame draws them from primitives. Each run is seeded from
+    // `seed`, and a game over starts the next one. Returns the number of
+    // runs played.
+    int runHeadless(int frames, Renderer &r, uint32_t seed, bool cacheLayers) {
+        persistRuns = false;
+        if (cacheLayers) carAtlas.bake(r);
+        int runs = 0;
+        for (int f = 0; f < frames; ++f) {
+            dispatcher.drain();
+            if (state != PLAYING) {
+                resetGame();
+                runSeed = seed + (uint32_t)runs++;
+                srand(runSeed);
+                state = PLAYING;
+            }
+            scheduler.process(frameCount);
+            beginUpdate();
+            updateGraph.run(jobQueue);
+            DrawList &dl = drawLists[frontList];
+            recordGameplay(dl);
+            endUpdate();
+            if (cacheLayers) prepareLayers(r);
+            dl.setBackground(sceneMgr.frame());
+            r.beginFrame();
+            dl.submit(r);
+            r.endFrame();
+        }
+        jobQueue.shutdown();
+        return runs;
+    }
+};
+
+// -------------------- traffic-stats --------------------
+// Run-history queries (`traffic-stats <query>`, or `main --stats <query>`).
+// Compacted runs are read straight from the mapped segment columns; only the
+// few thousand not yet compacted come from the logs.
+struct StatsQuery {
+    string history = "traffic_runs";
+    uint32_t top = 10;
+    int scene = -1;                 // -1: every scene
+    int64_t since = INT64_MIN;      // unix time; older runs are skipped
+    vector<string> scoreFiles;      // `percentiles`: score files whose sketches are merged
+};
+
+static int sceneByName(string name) {
+    for (auto &c : name) c = (char)toupper((unsigned char)c);
+    for (int s = 0; s < NUM_SCENES; ++s) {
+        if (name == SceneManager::sceneName((SceneType)s)) return s;
+    }
+    return -1;
+}
+
+// Calls fn(segment, row) for every row of `seg` whose timestamp may be >= since,
+// skipping whole zone blocks by their max timestamp.
+template <typename F>
+static bool forEachSegmentRow(RunSegment &seg, int64_t since, F fn) {
+    const int64_t *ts = seg.column<int64_t>(COL_TIMESTAMP);
+    if (!ts) return false;
+    for (uint32_t b = 0, first = 0; first < seg.rows(); ++b, first += seg.zoneRows()) {
+        const int64_t *z = seg.zone(COL_TIMESTAMP, b);
+        if (!z) return false;
+        if (z[1] < since) continue;
+        uint32_t last = min(seg.rows(), first + seg.zoneRows());
+        for (uint32_t r = first; r < last; ++r) if (ts[r] >= since) fn(r);
+    }
+    return true;
+}
+
+static void printPercentiles(vector<int64_t> &v, const char *label, double scale) {
+    auto at = [&v](double p) {
+        size_t k = (size_t)(p * (v.size() - 1) + 0.5);
+        nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    };
+    int64_t lo = *min_element(v.begin(), v.end()), hi = *max_element(v.begin(), v.end());
+    printf("%-10s %9zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", label, v.size(),
+           lo / scale, at(0.25) / scale, at(0.5) / scale, at(0.9) / scale, hi / scale);
+}
+
+// Top N per scene: each segment is walked in its score-order index and
+// abandoned as soon as every requested scene has N rows from it.
+static void statsTop(const StatsQuery &q, vector<unique_ptr<RunSegment>> &segments, const vector<RunRecord> &tail) {
+    vector<vector<ScoreRecord>> best(NUM_SCENES);
+    auto wanted = [&q](int s) { return s >= 0 && s < NUM_SCENES && (q.scene < 0 || q.scene == s); };
+    for (auto &seg : segments) {
+        const uint32_t *order = seg->column<uint32_t>(COL_SCORE_ORDER);
+        const int32_t *score = seg->column<int32_t>(COL_SCORE);
+        const uint8_t *scene = seg->column<uint8_t>(COL_FINAL_SCENE);
+        const int64_t *ts = seg->column<int64_t>(COL_TIMESTAMP);
+        const uint16_t *level = seg->column<uint16_t>(COL_LEVEL);
+        if (!order || !score || !scene || !ts || !level) { fprintf(stderr, "skipping damaged segment %u-%u\n", seg->firstId(), seg->lastId()); continue; }
+        vector<uint32_t> taken(NUM_SCENES, 0);
+        int open = q.scene < 0 ? NUM_SCENES : 1;
+        for (uint32_t i = 0; i < seg->rows() && open > 0; ++i) {
+            uint32_t r = order[i];
+            int s = scene[r];
+            if (!wanted(s) || ts[r] < q.since || taken[s] >= q.top) continue;
+            ScoreRecord rec;
+            memset(&rec, 0, sizeof(rec));
+            rec.score = score[r]; rec.timestamp = ts[r]; rec.level = level[r]; rec.scene = (uint8_t)s;
+            best[s].push_back(rec);
+            if (++taken[s] == q.top) open--;
+        }
+    }
+    for (auto &r : tail) if (wanted(r.finalScene) && r.timestamp >= q.since) best[r.finalScene].push_back(scoreRecordOf(r));
+
+    for (int s = 0; s < NUM_SCENES; ++s) {
+        if (!wanted(s)) continue;
+        vector<ScoreRecord> &v = best[s];
+        size_t n = min<size_t>(q.top, v.size());
+        partial_sort(v.begin(), v.begin() + n, v.end(), [](const ScoreRecord &a, const ScoreRecord &b) { return a.score > b.score; });
+        printf("%s\n", SceneManager::sceneName((SceneType)s));
+        for (size_t i = 0; i < n; ++i) printf("  %2d. %8d  level %3d\n", (int)i + 1, v[i].score, (int)v[i].level);
+        if (n == 0) printf("  (no runs)\n");
+    }
+}
+
+// Score distribution per level reached.
+static void statsLevels(const StatsQuery &q, vector<unique_ptr<RunSegment>> &segments, const vector<RunRecord> &tail) {
+    vector<vector<int64_t>> byLevel(MAX_LEVEL + 1);
+    for (auto &seg : segments) {
+        const int32_t *score = seg->column<int32_t>(COL_SCORE);
+        const uint16_t *level = seg->column<uint16_t>(COL_LEVEL);
+        const uint8_t *scene = seg->column<uint8_t>(COL_FINAL_SCENE);
+        if (!score || !level || !scene) continue;
+        forEachSegmentRow(*seg, q.since, [&](uint32_t r) {
+            if (level[r] <= MAX_LEVEL && (q.scene < 0 || scene[r] == q.scene)) byLevel[level[r]].push_back(score[r]);
+        });
+    }
+    for (auto &r : tail) {
+        if (r.timestamp >= q.since && r.level <= MAX_LEVEL && (q.scene < 0 || r.finalScene == q.scene)) byLevel[r.level].push_back(r.score);
+    }
+    printf("%-10s %9s %10s %10s %10s %10s %10s\n", "level", "runs", "min", "p25", "median", "p90", "max");
+    for (int l = 0; l <= MAX_LEVEL; ++l) {
+        if (byLevel[l].empty()) continue;
+        printPercentiles(byLevel[l], TextFormat("%d", l), 1.0);
+    }
+}
+
+// Survival time (seconds) per build.
+static void statsSurvival(const StatsQuery &q, vector<unique_ptr<RunSegment>> &segments, const vector<RunRecord> &tail) {
+    map<uint32_t, vector<int64_t>> byBuild;
+    for (auto &seg : segments) {
+        const uint32_t *frames = seg->column<uint32_t>(COL_FRAMES);
+        const uint32_t *build = seg->column<uint32_t>(COL_BUILD);
+        const uint8_t *scene = seg->column<uint8_t>(COL_FINAL_SCENE);
+        if (!frames || !build || !scene) continue;
+        forEachSegmentRow(*seg, q.since, [&](uint32_t r) {
+            if (q.scene < 0 || scene[r] == q.scene) byBuild[build[r]].push_back(frames[r]);
+        });
+    }
+    for (auto &r : tail) {
+        if (r.timestamp >= q.since && (q.scene < 0 || r.finalScene == q.scene)) byBuild[r.build].push_back(r.frames);
+    }
+    printf("%-10s %9s %10s %10s %10s %10s %10s\n", "build", "runs", "min s", "p25 s", "median s", "p90 s", "max s");
+    for (auto &b : byBuild) printPercentiles(b.second, TextFormat("%08x", b.first), FRAMES_PER_SEC);
+}
+
+// Score and survival percentiles from the score files' sketches, merged across
+// instances (e.g. one score file per cabinet). Needs no history at all.
+static int statsPercentiles(const StatsQuery &q) {
+    unique_ptr<ScoreSketches> merged(new ScoreSketches()), one(new ScoreSketches());
+    vector<string> files = q.scoreFiles;
+    if (files.empty()) files.push_back("traffic_scores.dat");
+    for (auto &f : files) {
+        MappedFile file;
+        ScoreFileView view;
+        const unsigned char *payload;
+        size_t bytes;
+        if (!file.open(f) || !view.open(file.data(), file.size()).empty() || !view.sketches(payload, bytes) || !one->decode(payload, bytes)) {
+            fprintf(stderr, "%s: no readable sketches\n", f.c_str());
+            return 1;
+        }
+        merged->merge(*one);
+    }
+    const QuantileSketch &sc = merged->scores;
+    printf("scores     %9.0f runs   p10 %8.0f   p50 %8.0f   p90 %8.0f   p99 %8.0f\n",
+           sc.count(), sc.quantile(0.1), sc.quantile(0.5), sc.quantile(0.9), sc.quantile(0.99));
+    printf("%-10s %9s %10s %10s %10s\n", "level", "runs", "p25 s", "median s", "p90 s");
+    for (int l = 0; l <= MAX_LEVEL; ++l) {
+        const QuantileSketch &sv = merged->survival[l];
+        if (sv.empty()) continue;
+        printf("%-10d %9.0f %10.1f %10.1f %10.1f\n", l, sv.count(), sv.quantile(0.25) / FRAMES_PER_SEC,
+               sv.quantile(0.5) / FRAMES_PER_SEC, sv.quantile(0.9) / FRAMES_PER_SEC);
+    }
+    return 0;
+}
+
+static int statsUsage() {
+    fprintf(stderr,
+        "usage: traffic-stats <query> [options]\n"
+        "queries:\n"
+        "  top        top N scores per scene\n"
+        "  levels     score distribution by level reached\n"
+        "  survival   survival time percentiles per build\n"
+        "  percentiles  score/survival percentiles from score-file sketches\n"
+        "options:\n"
+        "  -n N              rows per scene for `top` (default 10)\n"
+        "  --scene NAME      only runs that ended in this scene\n"
+        "  --since UNIXTIME  only runs finished at or after this time\n"
+        "  --history BASE    history files prefix (default traffic_runs)\n"
+        "  --scores FILE     score file to merge for `percentiles` (repeatable)\n");
+    return 2;
+}
+
+static int runTrafficStats(int argc, char **argv) {
+    if (argc < 1) return statsUsage();
+    string query = argv[0];
+    StatsQuery q;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-n" && hasValue) q.top = (uint32_t)max(1, atoi(argv[++i]));
+        else if (arg == "--scene" && hasValue) {
+            q.scene = sceneByName(argv[++i]);
+            if (q.scene < 0) { fprintf(stderr, "unknown scene '%s'\n", argv[i]); return 2; }
+        }
+        else if (arg == "--since" && hasValue) q.since = atoll(argv[++i]);
+        else if (arg == "--history" && hasValue) q.history = argv[++i];
+        else if (arg == "--scores" && hasValue) q.scoreFiles.push_back(argv[++i]);
+        else return statsUsage();
+    }
+    if (query == "percentiles") return statsPercentiles(q);
+    if (query != "top" && query != "levels" && query != "survival") return statsUsage();
+
+    SetTraceLogLevel(LOG_WARNING);
+    auto t0 = chrono::steady_clock::now();
+    RunHistory history(q.history);
+    vector<unique_ptr<RunSegment>> segments;
+    vector<RunRecord> tail;
+    history.snapshot(segments, tail);
+    uint64_t runs = tail.size();
+    for (auto &seg : segments) runs += seg->rows();
+
+    if (query == "top") statsTop(q, segments, tail);
+    else if (query == "levels") statsLevels(q, segments, tail);
+    else statsSurvival(q, segments, tail);
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    printf("(%llu runs in %zu segments + %zu uncompacted, %.1f ms)\n", (unsigned long long)runs, segments.size(), tail.size(), ms);
+    return 0;
+}
+
+// -------------------- Benchmarks --------------------
+// The original single-worker, LIFO job queue, kept only as a baseline.
+class LegacyJobQueue {
+    vector<function<void()>> jobs;
+    mutex mtx;
+    condition_variable cv;
+    thread worker;
+    atomic<bool> running;
+public:
+    LegacyJobQueue(): running(true) {
+        worker = thread([this]{
+            while (running) {
+                function<void()> job;
+                {
+                    unique_lock<mutex> lk(mtx);
+                    cv.wait(lk, [this]{ return !jobs.empty() || !running; });
+                    if (!running && jobs.empty()) break;
+                    job = move(jobs.back());
+                    jobs.pop_back();
+                }
+                if (job) job();
+            }
+        });
+    }
+    ~LegacyJobQueue() { shutdown(); }
+    void push(function<void()> job) {
+        {
+            lock_guard<mutex> lk(mtx);
+            jobs.push_back(move(job));
+        }
+        cv.notify_one();
+    }
+    void shutdown() {
+        if (running.exchange(false)) {
+            { lock_guard<mutex> lk(mtx); }
+            cv.notify_all();
+            if (worker.joinable()) worker.join();
+        }
+    }
 };
 
-int main() {
-    TrafficRacingGame game;
+// Pushes `count` jobs of `work` spin iterations each and returns jobs/second.
+template <typename Queue>
+static double benchQueueThroughput(Queue &q, int count, int work) {
+    atomic<int> done(0);
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        q.push([&done, work]{
+            volatile unsigned x = 0;
+            for (int k = 0; k < work; ++k) x = x + k;
+            done++;
+        });
+    }
+    while (done.load() < count) this_thread::yield();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    return count / max(secs, 1e-9);
+}
+
+static int runJobQueueBenchmark() {
+    const int counts[] = { 200000, 20000 };
+    const int works[] = { 0, 20000 };
+    cout << "JobQueue throughput (jobs/s)" << endl;
+    for (int i = 0; i < 2; ++i) {
+        double legacy, pool;
+        { LegacyJobQueue q; legacy = benchQueueThroughput(q, counts[i], works[i]); }
+        int threads;
+        { JobQueue q; threads = q.threadCount(); pool = benchQueueThroughput(q, counts[i], works[i]); }
+        cout << "  " << counts[i] << " jobs x " << works[i] << " spins: legacy " << (long long)legacy
+             << ", work-stealing(" << threads << ") " << (long long)pool
+             << " (" << pool / max(legacy, 1.0) << "x)" << endl;
+    }
+
+    // Tagged streams must preserve submission order
+    const int n = 10000;
+    vector<int> order;
+    {
+        JobQueue q;
+        for (int i = 0; i < n; ++i) q.push(JOB_STREAM_SCORES, [&order, i]{ order.push_back(i); });
+    }
+    bool fifo = (int)order.size() == n;
+    for (int i = 0; fifo && i < n; ++i) fifo = order[i] == i;
+    cout << "  stream FIFO order over " << n << " jobs: " << (fifo ? "OK" : "FAILED") << endl;
+    return fifo ? 0 : 1;
+}
+
+static SpawnScript benchIdleScript(ScriptRunner &r, uint64_t period, uint64_t *wakes) {
+    for (;;) {
+        co_await r.frames(period);
+        (*wakes)++;
+    }
+}
+
+// Many suspended scripts should only cost memory: frames where none of them
+// wake must be as cheap as an empty scheduler.
+static int runScriptBenchmark() {
+    const int scripts = 100000;
+    const uint64_t frames = 600;
+    EventScheduler sched;
+    ScriptRunner runner(sched);
+    uint64_t wakes = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < scripts; ++i) runner.start(benchIdleScript(runner, 300 + (uint64_t)(i % 997) * 10, &wakes), 1);
+    sched.process(1); // first resume: every script suspends on its first wait
+    double startMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+    double idleMs = 0, worstMs = 0;
+    for (uint64_t f = 2; f < frames; ++f) {
+        auto a = chrono::steady_clock::now();
+        sched.process(f);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - a).count();
+        worstMs = max(worstMs, ms);
+        idleMs += ms;
+    }
+    cout << "Spawn scripts: " << scripts << " suspended, " << CoroFramePool::instance().liveFrames() << " pooled frames" << endl;
+    cout << "  start " << startMs << " ms, " << frames - 2 << " frames avg " << idleMs / (frames - 2)
+         << " ms (worst " << worstMs << " ms), " << wakes << " wake-ups" << endl;
+    runner.clear();
+    return CoroFramePool::instance().liveFrames() == 0 ? 0 : 1;
+}
+
+// Cars on screen and car draw calls per frame with the base traffic script
+// at a few levels. Each frame is drawn as primitives and from the atlas
+// through a RecordingRenderer, which counts the calls each path issues.
+static int runCarDrawBenchmark() {
+    const int frames = 60 * FRAMES_PER_SEC;
+    SetTraceLogLevel(LOG_WARNING);
+    SceneManager scene;
+    RoadRenderer road;
+    CarAtlas atlas;
+    static ParticleSystem particles;    // too big for the stack; never drawn here
+    RecordingRenderer rec(scene, road, atlas, particles);
+    atlas.bake(rec);
+    Car player(ROAD_X + 60 + (2 * LANE_WIDTH), SCREEN_HEIGHT - 150, 2, 0.0f, PLAYER_CAR_COLOR, true);
+    cout.precision(3);
+    cout << "Car draw calls per frame (base traffic, " << frames << " frames)" << endl;
+    for (int level : { 1, 50, 100 }) {
+        srand(1234);
+        EnemyManager m;
+        m.setLevel(level);
+        int next = 0;
+        double cars = 0, primitiveCalls = 0, atlasCalls = 0;
+        size_t peak = 0;
+        for (int f = 0; f < frames; ++f) {
+            if (f == next) {
+                int lane = m.chooseSafeLane();
+                if (lane != -1) m.spawnAtLane(lane);
+                next = f + EnemyManager::trafficInterval(level);
+            }
+            m.update(false);
+            const vector<Car> &enemies = m.getEnemies();
+            cars += enemies.size();
+            peak = max(peak, enemies.size());
+            primitiveCalls += rec.measure([&]() {
+                for (const Car &c : enemies) c.draw(rec);
+                player.draw(rec);
+            }).calls;
+            atlasCalls += rec.measure([&]() {
+                rec.cars(enemies.data(), enemies.size());
+                rec.cars(&player, 1);
+            }).calls;
+        }
+        cout << "  level " << level << ": " << cars / frames << " cars avg (" << peak << " peak), primitives "
+             << primitiveCalls / frames << " calls avg -> atlas " << atlasCalls / frames << " calls avg" << endl;
+    }
+    atlas.unload(rec);
+    return 0;
+}
+
+// `main --headless[=frames]`: plays the game with no window through the
+// recording (or null) renderer and reports draw calls and vertices per
+// frame. The seed is fixed, so the traffic is the same from run to run, and
+// a run with `--no-layer-cache` gives the counts the baked layers save.
+static int runHeadless(int frames, bool record, bool cacheLayers, const string &tracePath, const GameOptions &opts) {
+    ofstream trace;
+    if (!tracePath.empty()) {
+        trace.open(tracePath);
+        if (!trace) { cerr << "Cannot write " << tracePath << endl; return 1; }
+    }
+    SetTraceLogLevel(LOG_WARNING);
+    TrafficRacingGame game(opts);
+    RecordingRenderer recorder = game.recorder(trace.is_open() ? &trace : nullptr);
+    NullRenderer null;
+    Renderer &r = record ? (Renderer &)recorder : (Renderer &)null;
+
+    auto t0 = chrono::steady_clock::now();
+    int runs = game.runHeadless(frames, r, 1234, cacheLayers);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+    cout.precision(3);
+    cout << "Headless: " << frames << " frames, " << runs << " runs, " << ms / frames << " ms per frame ("
+         << (record ? "recording" : "null") << " renderer, layer cache " << (cacheLayers ? "on" : "off") << ")" << endl;
+    if (!record) return 0;
+    double calls = 0, vertices = 0;
+    int peakCalls = 0;
+    long peakVertices = 0;
+    for (const RecordingRenderer::FrameStats &s : recorder.stats()) {
+        calls += s.calls;
+        vertices += s.vertices;
+        peakCalls = max(peakCalls, s.calls);
+        peakVertices = max(peakVertices, s.vertices);
+    }
+    cout << "  draw calls per frame: " << calls / frames << " avg, " << peakCalls << " peak" << endl;
+    cout << "  vertices per frame:   " << vertices / frames << " avg, " << peakVertices << " peak" << endl;
+    return 0;
+}
+
+// Load generator for the leaderboard daemon: `clients` concurrent connections
+// each submit `perClient` runs, unbatched and then batched + pipelined.
+static double benchLeaderboardSubmit(const string &sock, int clients, int perClient, size_t batch, int window, uint32_t seedBase) {
+    atomic<int> failures{0};
+    vector<thread> threads;
+    auto t0 = chrono::steady_clock::now();
+    for (int c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c]() {
+            vector<RunRecord> runs(perClient);
+            for (int i = 0; i < perClient; ++i) {
+                RunRecord &r = runs[i];
+                memset(&r, 0, sizeof(r));
+                r.timestamp = 1700000000 + i;
+                r.score = (i * 7919 + c * 104729) % 50000;
+                r.seed = seedBase + (uint32_t)c;
+                r.level = (uint16_t)(1 + r.score / LEVEL_SCORE_INTERVAL % MAX_LEVEL);
+                r.finalScene = (uint8_t)(i % NUM_SCENES);
+                sealRunRecord(r);
+            }
+            LeaderboardConnection conn;
+            size_t acked = 0;
+            for (int attempt = 0; attempt < 50 && !conn.open(sock); ++attempt) this_thread::sleep_for(chrono::milliseconds(20));
+            if (!conn.submit(runs.data(), runs.size(), batch, window, acked) || acked != runs.size()) failures++;
+        });
+    }
+    for (auto &t : threads) t.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    if (failures) cout << "  " << failures << " clients failed" << endl;
+    return clients * perClient / secs;
+}
+
+static int runLeaderboardBenchmark(int clients) {
+#ifndef _WIN32
+    string dir = (filesystem::temp_directory_path() / ("traffic_lb_bench_" + to_string(getpid()))).string();
+    filesystem::create_directories(dir);
+    string sock = dir + "/lb.sock";
+    atomic<bool> stop{false}, ready{false};
+    int rc = 0;
+    {
+        LeaderboardDaemon daemon(sock, dir + "/runs");
+        thread server([&]() { rc = daemon.run(stop, &ready); });
+        while (!ready && rc == 0) this_thread::sleep_for(chrono::milliseconds(5));
+        const int perClient = 200;
+        double single = benchLeaderboardSubmit(sock, clients, perClient, 1, 1, 0);
+        double batched = benchLeaderboardSubmit(sock, clients, perClient, LB_CLIENT_BATCH, LB_CLIENT_WINDOW, 1u << 20);
+        cout << "Leaderboard daemon, " << clients << " clients x " << perClient << " runs" << endl;
+        cout << "  one run per request: " << (long)single << " submissions/s" << endl;
+        cout << "  batched x" << LB_CLIENT_BATCH << ", window " << LB_CLIENT_WINDOW << ": " << (long)batched << " submissions/s" << endl;
+        stop = true;
+        server.join();
+    }
+    error_code ec;
+    filesystem::remove_all(dir, ec);
+    return rc;
+#else
+    (void)clients;
+    cout << "The leaderboard benchmark needs Unix domain sockets" << endl;
+    return 1;
+#endif
+}
+
+static atomic<bool> daemonStop{false};
+static void stopDaemon(int) { daemonStop = true; }
+
+static int runLeaderboardDaemon(const string &sock) {
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+    LeaderboardDaemon daemon(sock, "traffic_leaderboard_runs");
+    return daemon.run(daemonStop);
+}
+
+int main(int argc, char **argv) {
+    // The same binary is the history query tool when installed as traffic-stats
+    if (filesystem::path(argv[0]).stem() == "traffic-stats") return runTrafficStats(argc - 1, argv + 1);
+    if (argc > 1 && string(argv[1]) == "--stats") return runTrafficStats(argc - 2, argv + 2);
+    GameOptions opts;
+    int headlessFrames = 0;
+    bool headlessRecord = true;
+    bool headlessCache = true;
+    string headlessTrace;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--bench-jobs") return runJobQueueBenchmark();
+        if (arg == "--bench-scripts") return runScriptBenchmark();
+        if (arg == "--bench-cars") return runCarDrawBenchmark();
+        if (arg == "--bench-leaderboard") return runLeaderboardBenchmark(256);
+        if (arg.rfind("--bench-leaderboard=", 0) == 0) return runLeaderboardBenchmark(max(1, atoi(arg.c_str() + 20)));
+        if (arg == "--leaderboard-daemon") return runLeaderboardDaemon(opts.leaderboardSocket);
+        if (arg.rfind("--leaderboard-daemon=", 0) == 0) return runLeaderboardDaemon(arg.substr(21));
+        if (arg.rfind("--leaderboard-socket=", 0) == 0) opts.leaderboardSocket = arg.substr(21);
+        if (arg.rfind("--upload-budget-ms=", 0) == 0) opts.uploadBudgetMs = atof(arg.c_str() + 19);
+        if (arg.rfind("--weather-density=", 0) == 0) opts.weatherDensity = atoi(arg.c_str() + 18);
+        if (arg == "--no-pipeline") opts.pipeline = false;
+        if (arg == "--quality=auto") opts.autoQuality = true;
+        else if (arg.rfind("--quality=", 0) == 0) {
+            opts.autoQuality = true;
+            for (int t = 0; t < NUM_QUALITY_TIERS; ++t)
+                if (arg.substr(10) == QUALITY_TIERS[t].name) { opts.qualityTier = t; opts.autoQuality = false; }
+            if (opts.autoQuality) TraceLog(LOG_WARNING, "QUALITY: Unknown level '%s'; using auto", arg.c_str() + 10);
+        }
+        if (arg == "--render-scale=auto") opts.autoRenderScale = true;
+        else if (arg.rfind("--render-scale=", 0) == 0) opts.renderScale = (float)atof(arg.c_str() + 15);
+        if (arg == "--headless") headlessFrames = 60 * FRAMES_PER_SEC;
+        else if (arg.rfind("--headless=", 0) == 0) headlessFrames = max(1, atoi(arg.c_str() + 11));
+        if (arg == "--headless-renderer=null") headlessRecord = false;
+        if (arg == "--no-layer-cache") headlessCache = false;
+        if (arg.rfind("--headless-trace=", 0) == 0) headlessTrace = arg.substr(17);
+    }
+    if (headlessFrames > 0) return runHeadless(headlessFrames, headlessRecord, headlessCache, headlessTrace, opts);
+    TrafficRacingGame game(opts);
     game.run();
     return 0;
 }